@@ -1,11 +1,12 @@
 @echo off
 
-set commonCompilerFlags= -MD -nologo -Gm- -GR- -EHa- -O2 -Oi -arch:AVX -WX -W4 -WL -wd4100 -wd4201 -wd4189 -wd4505 -wd4127 -wd4238 -wd4324 -we4746 -FC -Z7 -Fm -D_DEBUG -DROOTD12INCLUDE
-set commonLinkerFlags= -incremental:no -opt:ref user32.lib Gdi32.lib winmm.lib d3d12.lib dxgi.lib d3dcompiler.lib
+set commonCompilerFlags= -MD -nologo -Gm- -GR- -EHa- -O2 -Oi -WX -W4 -WL -wd4100 -wd4201 -wd4189 -wd4505 -wd4127 -wd4238 -wd4324 -we4746 -FC -Z7 -Fm -D_DEBUG -DROOTD12INCLUDE
+set commonLinkerFlags= -incremental:no -opt:ref user32.lib Gdi32.lib winmm.lib advapi32.lib d3d12.lib dxgi.lib d3dcompiler.lib
 
 REM \WL one-line diagnostic
-REM \arch:AVX: for AVX support
+REM no \arch: the x64 baseline (SSE2), the image kernels have AVX2 and AVX-512 variants picked at startup (initImageKernels)
 REM -Zo: better debug info in optimized code
+REM -DARENA_PROFILER=1 counts every arena push by tag, the profile is dumped at exit (dumpArenaProfile)
 REM -fp:fast for floating point
 REM subsystem:console or windows usually, 5.2 for windows xp, 5.1 for windows xp 32 bit
 REM -MT statically link c runtime lib into exe
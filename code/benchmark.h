@@ -0,0 +1,945 @@
+#pragma once
+
+//NOTE: run the executable with -benchmark on the command line, the results go to the debugger output
+
+//the original work queue: a single shared ring which every consumer CASes on, kept here as the reference
+struct SharedRingWorkQueue
+{
+	u32 volatile nextEntryToWrite;
+	u32 volatile nextEntryToRead;
+	u32 volatile currentlyWorkingThreadCount;
+	WorkQueueEntry entries[256];
+	HANDLE semaphore;
+};
+
+static void pushEntry(SharedRingWorkQueue* queue, void* data, WorkQueueCallback* callback)
+{
+	u32 nextEntryToWrite = queue->nextEntryToWrite;
+	u32 newNextEntryToWrite = (nextEntryToWrite + 1) % ARRAY_SIZE(queue->entries);
+	busyWaitWhile(newNextEntryToWrite == queue->nextEntryToRead);
+
+	WorkQueueEntry* entry = queue->entries + queue->nextEntryToWrite;
+	entry->callback = callback;
+	entry->data = data;
+
+	_WriteBarrier();
+	queue->nextEntryToWrite = newNextEntryToWrite;
+
+	ReleaseSemaphore(queue->semaphore, 1, 0);
+}
+
+static WorkQueueEntry popEntry(SharedRingWorkQueue* queue)
+{
+	WorkQueueEntry result = {};
+	bool success = false;
+	while (!success)
+	{
+		u32 nextEntryToRead = queue->nextEntryToRead;
+		u32 newNextEntryToRead = (nextEntryToRead + 1) % ARRAY_SIZE(queue->entries);
+		if (nextEntryToRead != queue->nextEntryToWrite)
+		{
+			result = queue->entries[nextEntryToRead];
+			u32 nextEntryToRead2 = _InterlockedCompareExchange(
+				(volatile LONG*)&queue->nextEntryToRead,
+				(LONG)newNextEntryToRead,
+				nextEntryToRead
+			);
+
+			if (nextEntryToRead == nextEntryToRead2)
+			{
+				success = true;
+			}
+		}
+		else //queue is empty
+		{
+			result = {};
+			success = true;
+		}
+	}
+
+	return result;
+}
+
+static DWORD sharedRingThreadProc(LPVOID lpParam)
+{
+	SharedRingWorkQueue* queue = (SharedRingWorkQueue*)lpParam;
+	while (1)
+	{
+		DWORD waitResult = WaitForSingleObject(queue->semaphore, 0);
+		if (waitResult == WAIT_TIMEOUT)
+		{
+			_InterlockedDecrement((volatile LONG*)&queue->currentlyWorkingThreadCount);
+			waitResult = WaitForSingleObject(queue->semaphore, INFINITE);
+			_InterlockedIncrement((volatile LONG*)&queue->currentlyWorkingThreadCount);
+		}
+		ASSERT(waitResult == WAIT_OBJECT_0);
+
+		WorkQueueEntry entry = popEntry(queue);
+		ASSERT(entry.callback);
+		entry.callback(entry.data);
+	}
+	return 0;
+}
+
+static void flushQueue(SharedRingWorkQueue* queue)
+{
+	while (queue->nextEntryToRead != queue->nextEntryToWrite)
+	{
+		if (WaitForSingleObject(queue->semaphore, 0) == WAIT_OBJECT_0)
+		{
+			WorkQueueEntry entry = popEntry(queue);
+			ASSERT(entry.callback);
+			entry.callback(entry.data);
+		}
+	}
+	while (queue->currentlyWorkingThreadCount != 0);
+}
+
+static void initWorkQueue(SharedRingWorkQueue* queue, u32 threadCount)
+{
+	queue->nextEntryToRead = 0;
+	queue->nextEntryToWrite = 0;
+	queue->currentlyWorkingThreadCount = threadCount;
+	queue->semaphore = CreateSemaphoreA(0, 0, ARRAY_SIZE(queue->entries), 0);
+
+	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		DWORD threadID;
+		HANDLE threadHandle = CreateThread(0, 0, sharedRingThreadProc, queue, 0, &threadID);
+		CloseHandle(threadHandle);
+	}
+}
+
+//the original ticket mutex: every waiter spins on servingTicket, kept here as the reference for QueuedMutex
+struct SpinTicketMutex
+{
+	u64 volatile nextTicket;
+	u64 volatile servingTicket;
+};
+
+inline void beginSpinTicketMutex(SpinTicketMutex* mutex)
+{
+	u64 ticket = _InterlockedIncrement64((volatile LONGLONG*)&mutex->nextTicket) - 1;
+	busyWaitWhile(ticket != mutex->servingTicket);
+}
+inline void endSpinTicketMutex(SpinTicketMutex* mutex)
+{
+	_InterlockedIncrement64((volatile LONGLONG*)&mutex->servingTicket);
+}
+
+global u32 volatile g_benchmarkJobCounter;
+
+static void benchmarkJob(void* data)
+{
+	//roughly the cost of one small fractal tile octave, so the queue overhead is visible
+	u32 iterCount = (u32)(umm)data;
+	f32 x = 1.f;
+	for (u32 i = 0; i < iterCount; ++i)
+	{
+		x = x * 0.999f + 0.001f;
+	}
+	if (x == 0.f) //never true, keeps the loop
+	{
+		OutputDebugStringA("benchmarkJob\n");
+	}
+	_InterlockedIncrement((volatile LONG*)&g_benchmarkJobCounter);
+}
+
+#define BENCHMARK_JOB_COUNT (1 << 18)
+#define BENCHMARK_JOB_ITER_COUNT 256
+
+template<typename Queue>
+static f64 measureJobsPerSecond(Queue* queue)
+{
+	g_benchmarkJobCounter = 0;
+	LARGE_INTEGER start = Win32GetWallClock();
+	for (u32 jobIndex = 0; jobIndex < BENCHMARK_JOB_COUNT; ++jobIndex)
+	{
+		pushEntry(queue, (void*)(umm)BENCHMARK_JOB_ITER_COUNT, benchmarkJob);
+	}
+	flushQueue(queue);
+	f32 seconds = Win32GetSecondsElapsed(start, Win32GetWallClock());
+	ASSERT(g_benchmarkJobCounter == BENCHMARK_JOB_COUNT);
+
+	return (f64)BENCHMARK_JOB_COUNT / (f64)seconds;
+}
+
+static void benchmarkWorkQueues()
+{
+	//NOTE: the worker threads are never shut down, every configuration leaves its sleeping threads behind
+	char buff[256];
+	OutputDebugStringA("WorkQueue throughput (jobs/s)\n threads   shared ring   work stealing\n");
+
+	u32 maxThreadCount = MIN(getLogicalProcessorCount(), WORK_QUEUE_MAX_THREAD_COUNT);
+	u32 threadCounts[32];
+	u32 configCount = 0;
+	for (u32 threadCount = 1; threadCount < maxThreadCount; threadCount *= 2)
+	{
+		threadCounts[configCount++] = threadCount;
+	}
+	threadCounts[configCount++] = maxThreadCount;
+
+	for (u32 configIndex = 0; configIndex < configCount; ++configIndex)
+	{
+		u32 threadCount = threadCounts[configIndex];
+		SharedRingWorkQueue* sharedRingQueue = (SharedRingWorkQueue*)VirtualAlloc(0, sizeof(SharedRingWorkQueue), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		initWorkQueue(sharedRingQueue, threadCount);
+		f64 sharedRingJobsPerSecond = measureJobsPerSecond(sharedRingQueue);
+
+		WorkQueue* workStealingQueue = (WorkQueue*)VirtualAlloc(0, sizeof(WorkQueue), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		initWorkQueue(workStealingQueue, threadCount);
+		f64 workStealingJobsPerSecond = measureJobsPerSecond(workStealingQueue);
+
+		sprintf_s(buff, "%8u %13.0f %15.0f\n", threadCount, sharedRingJobsPerSecond, workStealingJobsPerSecond);
+		OutputDebugStringA(buff);
+	}
+}
+
+#define BENCHMARK_MUTEX_ACQUISITION_COUNT (1 << 16)
+
+struct MutexBenchmark
+{
+	void* mutex;
+	u32 volatile startedThreadCount;
+	u32 volatile finishedThreadCount;
+	u32 threadCount;
+	u64 counter; //protected by the mutex
+};
+
+template<typename Mutex, void(*beginMutex)(Mutex*), void(*endMutex)(Mutex*)>
+static DWORD mutexBenchmarkThreadProc(LPVOID lpParam)
+{
+	MutexBenchmark* benchmark = (MutexBenchmark*)lpParam;
+	Mutex* mutex = (Mutex*)benchmark->mutex;
+	_InterlockedIncrement((volatile LONG*)&benchmark->startedThreadCount);
+	busyWaitWhile(benchmark->startedThreadCount != benchmark->threadCount);
+
+	for (u32 acquisitionIndex = 0; acquisitionIndex < BENCHMARK_MUTEX_ACQUISITION_COUNT; ++acquisitionIndex)
+	{
+		beginMutex(mutex);
+		++benchmark->counter;
+		endMutex(mutex);
+	}
+	_InterlockedIncrement((volatile LONG*)&benchmark->finishedThreadCount);
+	return 0;
+}
+
+template<typename Mutex, void(*beginMutex)(Mutex*), void(*endMutex)(Mutex*)>
+static f64 measureAcquisitionsPerSecond(Mutex* mutex, u32 threadCount)
+{
+	MutexBenchmark benchmark = {};
+	benchmark.mutex = mutex;
+	benchmark.threadCount = threadCount;
+
+	LARGE_INTEGER start = Win32GetWallClock();
+	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		DWORD threadID;
+		HANDLE threadHandle = CreateThread(0, 0, mutexBenchmarkThreadProc<Mutex, beginMutex, endMutex>, &benchmark, 0, &threadID);
+		CloseHandle(threadHandle);
+	}
+	while (benchmark.finishedThreadCount != threadCount)
+	{
+		Sleep(1);
+	}
+	f32 seconds = Win32GetSecondsElapsed(start, Win32GetWallClock());
+	ASSERT(benchmark.counter == (u64)threadCount * BENCHMARK_MUTEX_ACQUISITION_COUNT);
+
+	return (f64)benchmark.counter / (f64)seconds;
+}
+
+static void benchmarkMutexes()
+{
+	char buff[256];
+	OutputDebugStringA("Mutex throughput (acquisitions/s)\n threads        ticket          queued\n");
+
+	u32 maxThreadCount = getLogicalProcessorCount();
+	for (u32 threadCount = 1; threadCount <= 2 * maxThreadCount; threadCount *= 2)
+	{
+		SpinTicketMutex ticketMutex = {};
+		f64 ticketAcquisitionsPerSecond = measureAcquisitionsPerSecond<SpinTicketMutex, beginSpinTicketMutex, endSpinTicketMutex>(&ticketMutex, threadCount);
+		QueuedMutex queuedMutex = {};
+		f64 queuedAcquisitionsPerSecond = measureAcquisitionsPerSecond<QueuedMutex, beginQueuedMutex, endQueuedMutex>(&queuedMutex, threadCount);
+
+		sprintf_s(buff, "%8u %13.0f %15.0f\n", threadCount, ticketAcquisitionsPerSecond, queuedAcquisitionsPerSecond);
+		OutputDebugStringA(buff);
+		dumpQueuedMutexStats(&queuedMutex, "benchmark");
+	}
+}
+
+#define BENCHMARK_IMAGE_SIZE 4096
+#define BENCHMARK_IMAGE_REPEAT_COUNT 3
+
+struct ImageKernelTimes
+{
+	f32 normalMap;
+	f32 mipLevels;
+	f32 scale;
+};
+
+static ImageKernelTimes measureImageKernels(WorkQueue* queue, MemoryArena* arena)
+{
+	//NOTE: the best of a few runs in ms, the first run also pays for the page faults
+	Image2DLod heightMap = pushImage2DLod(arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, f32);
+	Image2D normalMap = pushImage2D(arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, u32);
+	Image2D grad = pushImage2D(arena, 64, 64, v2);
+	fillWithRandomGradients(&grad, 1234);
+	clearImage2D(&heightMap.lod[0]);
+	v2 range = addPerlinNoiseSIMD(&heightMap.lod[0], &grad, BENCHMARK_IMAGE_SIZE / 2, BENCHMARK_IMAGE_SIZE / 2, 256, 1.f);
+
+	ImageKernelTimes result = { 1e10f, 1e10f, 1e10f };
+	for (u32 repeatIndex = 0; repeatIndex < BENCHMARK_IMAGE_REPEAT_COUNT; ++repeatIndex)
+	{
+		LARGE_INTEGER start = Win32GetWallClock();
+		fillNormalMapForHeightMapSIMD(&heightMap.lod[0], &normalMap);
+		LARGE_INTEGER normalMapEnd = Win32GetWallClock();
+		generateMipLevels1F32SIMD(queue, &heightMap);
+		LARGE_INTEGER mipLevelsEnd = Win32GetWallClock();
+		scaleImageSIMD(&heightMap.lod[0], range, range);
+		LARGE_INTEGER scaleEnd = Win32GetWallClock();
+
+		result.normalMap = MIN(result.normalMap, 1000.f * Win32GetSecondsElapsed(start, normalMapEnd));
+		result.mipLevels = MIN(result.mipLevels, 1000.f * Win32GetSecondsElapsed(normalMapEnd, mipLevelsEnd));
+		result.scale = MIN(result.scale, 1000.f * Win32GetSecondsElapsed(mipLevelsEnd, scaleEnd));
+	}
+
+	return result;
+}
+
+static void benchmarkLargePages(WorkQueue* queue)
+{
+	char buff[256];
+	umm arenaSize = 256 * 1024 * 1024;
+
+	void* smallPageMemory = VirtualAlloc(0, arenaSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	ASSERT(smallPageMemory);
+	MemoryArena smallPageArena = createMemoryArena(smallPageMemory, arenaSize);
+	ImageKernelTimes smallPageTimes = measureImageKernels(queue, &smallPageArena);
+	VirtualFree(smallPageMemory, 0, MEM_RELEASE);
+
+	enableLargePagePrivilege();
+	MemoryArena largePageArena = createLargePageMemoryArena(arenaSize);
+	ImageKernelTimes largePageTimes = measureImageKernels(queue, &largePageArena);
+	VirtualFree(largePageArena.base, 0, MEM_RELEASE);
+
+	sprintf_s(buff, "Image kernels on %ux%u (ms)\n kernel      small pages  %s\n", BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE,
+		largePageArena.largePages ? "large pages" : "large pages not available, small again");
+	OutputDebugStringA(buff);
+	sprintf_s(buff, " normal map %12.2f %12.2f\n mip levels %12.2f %12.2f\n scale      %12.2f %12.2f\n",
+		smallPageTimes.normalMap, largePageTimes.normalMap, smallPageTimes.mipLevels, largePageTimes.mipLevels, smallPageTimes.scale, largePageTimes.scale);
+	OutputDebugStringA(buff);
+}
+
+#define BENCHMARK_ARENA_TEMP_SIZE (256 * 1024 * 1024)
+#define BENCHMARK_ARENA_REPEAT_COUNT 8
+
+static b32 isCommitted(void* address)
+{
+	MEMORY_BASIC_INFORMATION info = {};
+	VirtualQuery(address, &info, sizeof(info));
+	return info.State == MEM_COMMIT;
+}
+
+static f32 measureTempScopes(MemoryArena* arena)
+{
+	//NOTE: in ms per scope, every page of the temp memory is touched once
+	LARGE_INTEGER start = Win32GetWallClock();
+	for (u32 repeatIndex = 0; repeatIndex < BENCHMARK_ARENA_REPEAT_COUNT; ++repeatIndex)
+	{
+		TempMemory temp = startTempMemory(arena);
+		u8* memory = pushArray(arena, BENCHMARK_ARENA_TEMP_SIZE, u8);
+		ASSERT(memory);
+		for (umm offset = 0; offset < BENCHMARK_ARENA_TEMP_SIZE; offset += 4096)
+		{
+			memory[offset] = 1;
+		}
+		endTempMemory(&temp);
+	}
+	return 1000.f * Win32GetSecondsElapsed(start, Win32GetWallClock()) / (f32)BENCHMARK_ARENA_REPEAT_COUNT;
+}
+
+static void benchmarkGrowableArena()
+{
+	//NOTE: a rewind with decommitOnRewind has to give the pages back, and the next push has to get them again, zeroed
+	char buff[256];
+	umm reserveSize = 1024 * 1024 * 1024;
+
+	MemoryArena arena = createGrowableMemoryArena(reserveSize, true);
+	u8* kept = pushArray(&arena, 1000, u8);
+	memset(kept, 0xcd, 1000);
+
+	TempMemory temp = startTempMemory(&arena);
+	u8* memory = pushArray(&arena, BENCHMARK_ARENA_TEMP_SIZE, u8);
+	memset(memory, 0xab, BENCHMARK_ARENA_TEMP_SIZE);
+	ASSERT(isCommitted(memory + BENCHMARK_ARENA_TEMP_SIZE - 1));
+	endTempMemory(&temp);
+	ASSERT(arena.committedSize <= 2 * ARENA_COMMIT_SIZE);
+	ASSERT(!isCommitted(memory + BENCHMARK_ARENA_TEMP_SIZE - 1));
+	ASSERT(kept[999] == 0xcd);
+
+	temp = startTempMemory(&arena);
+	u8* recommitted = pushArray(&arena, BENCHMARK_ARENA_TEMP_SIZE, u8);
+	ASSERT(recommitted == memory);
+	ASSERT(isCommitted(recommitted + BENCHMARK_ARENA_TEMP_SIZE - 1));
+	ASSERT(recommitted[BENCHMARK_ARENA_TEMP_SIZE - 1] == 0);
+	endTempMemory(&temp);
+
+	MemoryArena keepingArena = createGrowableMemoryArena(reserveSize);
+	f32 keepingTime = measureTempScopes(&keepingArena);
+	f32 decommittingTime = measureTempScopes(&arena);
+	sprintf_s(buff, "Growable arena, %u MB temp scopes: %.2f ms each keeping the pages, %.2f ms each decommitting them\n",
+		BENCHMARK_ARENA_TEMP_SIZE / (1024 * 1024), keepingTime, decommittingTime);
+	OutputDebugStringA(buff);
+
+	VirtualFree(arena.base, 0, MEM_RELEASE);
+	VirtualFree(keepingArena.base, 0, MEM_RELEASE);
+}
+
+#define BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT (1 << 14)
+
+struct ConcurrentArenaBenchmark
+{
+	ConcurrentMemoryArena* arena;
+	MemoryArena* lockedArena; //pushed to under the mutex instead when set
+	QueuedMutex mutex;
+	u32 volatile startedThreadCount;
+	u32 volatile finishedThreadCount;
+	u32 volatile nextThreadIndex;
+	u32 threadCount;
+	u8** pushes; //BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT for every thread
+};
+
+static umm getBenchmarkPushSize(u32 threadIndex, u32 pushIndex)
+{
+	//NOTE: mostly small ones from the chunks, every 256th is big enough to go straight to the arena
+	return (pushIndex & 255) == 255 ? CONCURRENT_ARENA_CHUNK_SIZE / 2 + threadIndex : 16 + (pushIndex * 7 + threadIndex) % 256;
+}
+
+static DWORD concurrentArenaBenchmarkThreadProc(LPVOID lpParam)
+{
+	ConcurrentArenaBenchmark* benchmark = (ConcurrentArenaBenchmark*)lpParam;
+	u32 threadIndex = _InterlockedIncrement((volatile LONG*)&benchmark->nextThreadIndex) - 1;
+	u8** pushes = benchmark->pushes + threadIndex * BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT;
+	_InterlockedIncrement((volatile LONG*)&benchmark->startedThreadCount);
+	busyWaitWhile(benchmark->startedThreadCount != benchmark->threadCount);
+
+	for (u32 pushIndex = 0; pushIndex < BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT; ++pushIndex)
+	{
+		umm size = getBenchmarkPushSize(threadIndex, pushIndex);
+		u8* memory;
+		if (benchmark->lockedArena)
+		{
+			beginQueuedMutex(&benchmark->mutex);
+			memory = pushArray(benchmark->lockedArena, size, u8);
+			endQueuedMutex(&benchmark->mutex);
+		}
+		else
+		{
+			memory = pushArray(benchmark->arena, size, u8);
+		}
+		ASSERT(memory);
+		memset(memory, (u8)(threadIndex * 31 + pushIndex), size);
+		pushes[pushIndex] = memory;
+	}
+	_InterlockedIncrement((volatile LONG*)&benchmark->finishedThreadCount);
+	return 0;
+}
+
+static f64 measurePushesPerSecond(ConcurrentMemoryArena* arena, MemoryArena* lockedArena, u32 threadCount)
+{
+	ConcurrentArenaBenchmark benchmark = {};
+	benchmark.arena = arena;
+	benchmark.lockedArena = lockedArena;
+	benchmark.threadCount = threadCount;
+	umm pushesSize = (umm)threadCount * BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT * sizeof(u8*);
+	benchmark.pushes = (u8**)VirtualAlloc(0, pushesSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	ASSERT(benchmark.pushes);
+
+	LARGE_INTEGER start = Win32GetWallClock();
+	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		DWORD threadID;
+		HANDLE threadHandle = CreateThread(0, 0, concurrentArenaBenchmarkThreadProc, &benchmark, 0, &threadID);
+		CloseHandle(threadHandle);
+	}
+	while (benchmark.finishedThreadCount != threadCount)
+	{
+		Sleep(1);
+	}
+	f32 seconds = Win32GetSecondsElapsed(start, Win32GetWallClock());
+
+	//NOTE: two pushes which overlap would have overwritten each other's pattern
+	u8* base = lockedArena ? lockedArena->base : arena->base;
+	umm size = lockedArena ? lockedArena->size : arena->size;
+	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		for (u32 pushIndex = 0; pushIndex < BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT; ++pushIndex)
+		{
+			u8* memory = benchmark.pushes[threadIndex * BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT + pushIndex];
+			umm pushSize = getBenchmarkPushSize(threadIndex, pushIndex);
+			ASSERT(memory >= base && memory + pushSize <= base + size);
+			for (umm byteIndex = 0; byteIndex < pushSize; ++byteIndex)
+			{
+				ASSERT(memory[byteIndex] == (u8)(threadIndex * 31 + pushIndex));
+			}
+		}
+	}
+	VirtualFree(benchmark.pushes, 0, MEM_RELEASE);
+
+	return (f64)threadCount * BENCHMARK_CONCURRENT_ARENA_PUSH_COUNT / (f64)seconds;
+}
+
+static void benchmarkConcurrentArena()
+{
+	//NOTE: a push which doesn't fit must not use up the arena for the smaller ones which still do
+	umm fixedSize = 4 * CONCURRENT_ARENA_CHUNK_SIZE;
+	void* fixedMemory = VirtualAlloc(0, fixedSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	ConcurrentMemoryArena fixedArena = createConcurrentMemoryArena(fixedMemory, fixedSize);
+	ASSERT(!pushArray(&fixedArena, 2 * fixedSize, u8));
+	ASSERT(fixedArena.offset == 0);
+	ASSERT(pushArray(&fixedArena, 3 * CONCURRENT_ARENA_CHUNK_SIZE, u8));
+	ASSERT(!pushArray(&fixedArena, 2 * CONCURRENT_ARENA_CHUNK_SIZE, u8));
+	ASSERT(pushArray(&fixedArena, 100, u8)); //takes the last chunk
+	ASSERT(fixedArena.offset == fixedSize);
+	VirtualFree(fixedMemory, 0, MEM_RELEASE);
+
+	char buff[256];
+	OutputDebugStringA("Arena throughput (pushes/s)\n threads    concurrent  locked arena\n");
+
+	umm reserveSize = 4ull * 1024 * 1024 * 1024;
+	u32 maxThreadCount = getLogicalProcessorCount();
+	for (u32 threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2)
+	{
+		ConcurrentMemoryArena arena = createGrowableConcurrentMemoryArena(reserveSize);
+		f64 concurrentPushesPerSecond = measurePushesPerSecond(&arena, 0, threadCount);
+		VirtualFree(arena.base, 0, MEM_RELEASE);
+
+		MemoryArena lockedArena = createGrowableMemoryArena(reserveSize);
+		f64 lockedPushesPerSecond = measurePushesPerSecond(0, &lockedArena, threadCount);
+		VirtualFree(lockedArena.base, 0, MEM_RELEASE);
+
+		sprintf_s(buff, "%8u %13.0f %13.0f\n", threadCount, concurrentPushesPerSecond, lockedPushesPerSecond);
+		OutputDebugStringA(buff);
+	}
+}
+
+#define BENCHMARK_POOL_ELEMENT_COUNT 4096 //for every thread in every round
+#define BENCHMARK_POOL_ROUND_COUNT 16
+
+struct PoolBenchmarkElement
+{
+	u32 threadIndex;
+	u32 elementIndex;
+	u8 payload[56];
+};
+
+struct PoolBenchmark
+{
+	MemoryPool* pool;
+	u32 threadCount;
+	u32 volatile nextThreadIndex;
+	u32 volatile arrivedCount; //every thread adds one at every barrier
+	u32 volatile finishedThreadCount;
+	PoolBenchmarkElement** elements; //BENCHMARK_POOL_ELEMENT_COUNT for every thread
+};
+
+static void waitForPoolBenchmarkThreads(PoolBenchmark* benchmark, u32* barrierIndex)
+{
+	++*barrierIndex;
+	_InterlockedIncrement((volatile LONG*)&benchmark->arrivedCount);
+	busyWaitWhile(benchmark->arrivedCount < *barrierIndex * benchmark->threadCount);
+}
+
+static DWORD poolBenchmarkThreadProc(LPVOID lpParam)
+{
+	PoolBenchmark* benchmark = (PoolBenchmark*)lpParam;
+	u32 threadIndex = _InterlockedIncrement((volatile LONG*)&benchmark->nextThreadIndex) - 1;
+	u32 barrierIndex = 0;
+	waitForPoolBenchmarkThreads(benchmark, &barrierIndex);
+
+	for (u32 roundIndex = 0; roundIndex < BENCHMARK_POOL_ROUND_COUNT; ++roundIndex)
+	{
+		PoolBenchmarkElement** elements = benchmark->elements + threadIndex * BENCHMARK_POOL_ELEMENT_COUNT;
+		for (u32 elementIndex = 0; elementIndex < BENCHMARK_POOL_ELEMENT_COUNT; ++elementIndex)
+		{
+			PoolBenchmarkElement* element = allocateFromPool(benchmark->pool, PoolBenchmarkElement);
+			ASSERT(element);
+			element->threadIndex = threadIndex;
+			element->elementIndex = elementIndex;
+			elements[elementIndex] = element;
+		}
+		waitForPoolBenchmarkThreads(benchmark, &barrierIndex);
+
+		//NOTE: the elements of another thread are freed, so they move between the thread caches. An element handed out twice
+		// would have the other owner written into it
+		u32 otherThreadIndex = (threadIndex + roundIndex + 1) % benchmark->threadCount;
+		elements = benchmark->elements + otherThreadIndex * BENCHMARK_POOL_ELEMENT_COUNT;
+		for (u32 elementIndex = 0; elementIndex < BENCHMARK_POOL_ELEMENT_COUNT; ++elementIndex)
+		{
+			PoolBenchmarkElement* element = elements[elementIndex];
+			ASSERT(element->threadIndex == otherThreadIndex && element->elementIndex == elementIndex);
+			freeToPool(benchmark->pool, element);
+		}
+		waitForPoolBenchmarkThreads(benchmark, &barrierIndex);
+	}
+	_InterlockedIncrement((volatile LONG*)&benchmark->finishedThreadCount);
+	return 0;
+}
+
+static void benchmarkMemoryPool()
+{
+	char buff[256];
+	OutputDebugStringA("Memory pool with thread caches, cross thread frees\n threads  allocations+frees/s  elements taken from the arena\n");
+
+	u32 maxThreadCount = getLogicalProcessorCount();
+	for (u32 threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2)
+	{
+		ConcurrentMemoryArena arena = createGrowableConcurrentMemoryArena(1024 * 1024 * 1024);
+		MemoryPool pool = createMemoryPool(&arena, PoolBenchmarkElement);
+		PoolBenchmark benchmark = {};
+		benchmark.pool = &pool;
+		benchmark.threadCount = threadCount;
+		umm elementsSize = (umm)threadCount * BENCHMARK_POOL_ELEMENT_COUNT * sizeof(PoolBenchmarkElement*);
+		benchmark.elements = (PoolBenchmarkElement**)VirtualAlloc(0, elementsSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		ASSERT(benchmark.elements);
+
+		LARGE_INTEGER start = Win32GetWallClock();
+		for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+		{
+			DWORD threadID;
+			HANDLE threadHandle = CreateThread(0, 0, poolBenchmarkThreadProc, &benchmark, 0, &threadID);
+			CloseHandle(threadHandle);
+		}
+		while (benchmark.finishedThreadCount != threadCount)
+		{
+			Sleep(1);
+		}
+		f32 seconds = Win32GetSecondsElapsed(start, Win32GetWallClock());
+
+		//NOTE: the pool only grows when the shared list is empty, then every free element sits in a thread cache
+		ASSERT(pool.elementCount <= threadCount * (BENCHMARK_POOL_ELEMENT_COUNT + 2 * MEMORY_POOL_CACHE_BATCH_COUNT) + pool.blockElementCount);
+
+		f64 operationsPerSecond = 2.0 * threadCount * BENCHMARK_POOL_ELEMENT_COUNT * BENCHMARK_POOL_ROUND_COUNT / (f64)seconds;
+		sprintf_s(buff, "%8u %20.0f %30llu\n", threadCount, operationsPerSecond, pool.elementCount);
+		OutputDebugStringA(buff);
+
+		VirtualFree(benchmark.elements, 0, MEM_RELEASE);
+		VirtualFree(arena.base, 0, MEM_RELEASE);
+	}
+}
+
+#define BENCHMARK_PERLIN_MAX_TILE_SIZE 1024
+
+static void benchmarkPerlinOctaves()
+{
+	//NOTE: one pass per octave against all octaves in one pass over the same grads, the images have to come out bit for bit the same
+	char buff[256];
+	umm arenaSize = 256 * 1024 * 1024;
+	MemoryArena arena = createGrowableMemoryArena(arenaSize);
+
+	Image2D perOctave = pushImage2D(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, f32);
+	Image2D fused = pushImage2D(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, f32);
+	Image2D grad = pushImage2D(&arena, 64, 64, v2);
+	fillWithRandomGradients(&grad, 4321);
+
+	PerlinOctave octaves[PERLIN_MAX_OCTAVE_COUNT];
+	u32 octaveCount = getPerlinOctaves(octaves, &grad, BENCHMARK_PERLIN_MAX_TILE_SIZE, 1.f);
+
+	f32 perOctaveTime = 1e10f;
+	f32 fusedTime = 1e10f;
+	v2 perOctaveRange = {};
+	v2 fusedRange = {};
+	for (u32 repeatIndex = 0; repeatIndex < BENCHMARK_IMAGE_REPEAT_COUNT; ++repeatIndex)
+	{
+		clearImage2D(&perOctave);
+		clearImage2D(&fused);
+
+		LARGE_INTEGER start = Win32GetWallClock();
+		for (u32 octaveIndex = 0; octaveIndex < octaveCount; ++octaveIndex)
+		{
+			PerlinOctave* octave = octaves + octaveIndex;
+			perOctaveRange = addPerlinNoiseSIMD(&perOctave, octave->grad, octave->gradAlignX, octave->gradAlignY, octave->tileSize, octave->heightScale);
+		}
+		LARGE_INTEGER perOctaveEnd = Win32GetWallClock();
+		fusedRange = addPerlinNoiseOctavesSIMD(&fused, octaves, octaveCount);
+		LARGE_INTEGER fusedEnd = Win32GetWallClock();
+
+		perOctaveTime = MIN(perOctaveTime, 1000.f * Win32GetSecondsElapsed(start, perOctaveEnd));
+		fusedTime = MIN(fusedTime, 1000.f * Win32GetSecondsElapsed(perOctaveEnd, fusedEnd));
+	}
+
+	b32 same = perOctaveRange.x == fusedRange.x && perOctaveRange.y == fusedRange.y;
+	for (u32 y = 0; y < BENCHMARK_IMAGE_SIZE && same; ++y)
+	{
+		same = memcmp(perOctave.memory + y * perOctave.pitch, fused.memory + y * fused.pitch, BENCHMARK_IMAGE_SIZE * sizeof(f32)) == 0;
+	}
+	ASSERT(same);
+
+	//NOTE: every pass reads and writes the whole image, the grads stay in the cache
+	f32 imageMegaBytes = (f32)(BENCHMARK_IMAGE_SIZE * BENCHMARK_IMAGE_SIZE * sizeof(f32)) / (1024.f * 1024.f);
+	sprintf_s(buff, "Perlin noise, %u octaves on %ux%u (%s)\n           ms  image traffic (MB)\n", octaveCount, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE,
+		same ? "same result" : "RESULTS DIFFER");
+	OutputDebugStringA(buff);
+	sprintf_s(buff, " per octave %8.2f %10.0f\n fused      %8.2f %10.0f\n",
+		perOctaveTime, 2.f * octaveCount * imageMegaBytes, fusedTime, 2.f * imageMegaBytes);
+	OutputDebugStringA(buff);
+
+	VirtualFree(arena.base, 0, MEM_RELEASE);
+}
+
+struct ColorMipLevelsResult
+{
+	f32 scalarTime;
+	f32 simdTime;
+	u32 maxHalvingDiff;
+	u32 maxResampleDiff;
+};
+
+static ColorMipLevelsResult measureColorMipLevels(WorkQueue* queue, MemoryArena* arena, u32 width, u32 height, b32 srgb)
+{
+	ColorMipLevelsResult result = { 1e10f, 1e10f };
+	TempMemory tempMemory = startTempMemory(arena);
+
+	Image2DLod scalar = pushImage2DLod(arena, width, height, u32);
+	Image2DLod simd = pushImage2DLod(arena, width, height, u32);
+	u32 seed = 97;
+	for (u32 y = 0; y < height; ++y)
+	{
+		u32* scalarPixel = (u32*)(scalar.lod[0].memory + y * scalar.lod[0].pitch);
+		u32* simdPixel = (u32*)(simd.lod[0].memory + y * simd.lod[0].pitch);
+		for (u32 x = 0; x < width; ++x)
+		{
+			seed = seed * 1664525 + 1013904223;
+			scalarPixel[x] = simdPixel[x] = seed;
+		}
+	}
+
+	for (u32 repeatIndex = 0; repeatIndex < BENCHMARK_IMAGE_REPEAT_COUNT; ++repeatIndex)
+	{
+		LARGE_INTEGER start = Win32GetWallClock();
+		generateMipLevels4U8(&scalar, srgb);
+		LARGE_INTEGER scalarEnd = Win32GetWallClock();
+		generateMipLevels4U8SIMD(queue, &simd, srgb);
+		LARGE_INTEGER simdEnd = Win32GetWallClock();
+
+		result.scalarTime = MIN(result.scalarTime, 1000.f * Win32GetSecondsElapsed(start, scalarEnd));
+		result.simdTime = MIN(result.simdTime, 1000.f * Win32GetSecondsElapsed(scalarEnd, simdEnd));
+	}
+
+	//NOTE: every lod is checked against the scalar reference run on the same previous lod, so a difference is not carried down the chain
+	for (u32 lod = 1; lod < simd.lodCount; ++lod)
+	{
+		Image2DLod reference = {};
+		reference.lod[0] = simd.lod[lod - 1];
+		reference.lod[1] = scalar.lod[lod];
+		reference.lodCount = 2;
+		generateMipLevels4U8(&reference, srgb);
+
+		Image2D* expected = &reference.lod[1];
+		Image2D* actual = &simd.lod[lod];
+		b32 exactHalving = reference.lod[0].width == 2 * actual->width && reference.lod[0].height == 2 * actual->height;
+		for (u32 y = 0; y < actual->height; ++y)
+		{
+			u8* expectedChannel = expected->memory + y * expected->pitch;
+			u8* actualChannel = actual->memory + y * actual->pitch;
+			for (u32 x = 0; x < actual->width * 4; ++x)
+			{
+				u32 diff = (u32)abs((s32)expectedChannel[x] - (s32)actualChannel[x]);
+				if (exactHalving)
+				{
+					result.maxHalvingDiff = MAX(result.maxHalvingDiff, diff);
+					if (!srgb)
+					{
+						//NOTE: the integer average has to be the exact floor of the mean of the four texels
+						Image2D* src = &reference.lod[0];
+						u8* top = src->memory + 2 * y * src->pitch + 2 * (x / 4) * sizeof(u32) + x % 4;
+						u8* bottom = top + src->pitch;
+						ASSERT(actualChannel[x] == (top[0] + top[4] + bottom[0] + bottom[4]) / 4);
+					}
+				}
+				else
+				{
+					result.maxResampleDiff = MAX(result.maxResampleDiff, diff);
+				}
+			}
+		}
+	}
+
+	endTempMemory(&tempMemory);
+	return result;
+}
+
+static void benchmarkColorMipLevels(WorkQueue* queue)
+{
+	//NOTE: only the exact halvings can differ from the scalar reference, by one at most (see downsample2x2U8x4). Without sRGB they are
+	// checked for equality against the integer mean instead
+	char buff[256];
+	umm arenaSize = 512 * 1024 * 1024;
+	MemoryArena arena = createGrowableMemoryArena(arenaSize);
+
+	u32 sizes[][2] = { { BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE }, { 3000, 1000 } };
+	sprintf_s(buff, "RGBA8 mip levels (ms)\n size       srgb   scalar     simd  max diff (halving, other)\n");
+	OutputDebugStringA(buff);
+	for (u32 sizeIndex = 0; sizeIndex < ARRAY_SIZE(sizes); ++sizeIndex)
+	{
+		for (u32 srgb = 0; srgb < 2; ++srgb)
+		{
+			u32 width = sizes[sizeIndex][0];
+			u32 height = sizes[sizeIndex][1];
+			ColorMipLevelsResult result = measureColorMipLevels(queue, &arena, width, height, srgb);
+			ASSERT(result.maxHalvingDiff <= 1 && result.maxResampleDiff == 0);
+
+			sprintf_s(buff, " %4ux%-4u %5s %8.2f %8.2f %9u %5u\n", width, height, srgb ? "yes" : "no", result.scalarTime, result.simdTime, result.maxHalvingDiff, result.maxResampleDiff);
+			OutputDebugStringA(buff);
+		}
+	}
+
+	VirtualFree(arena.base, 0, MEM_RELEASE);
+}
+
+static void benchmarkNormalMaps(WorkQueue* queue)
+{
+	//NOTE: every lod of a height map, like at startup. The fast reciprocal square root can put a channel one off from the scalar version
+	char buff[256];
+	umm arenaSize = 512 * 1024 * 1024;
+	MemoryArena arena = createGrowableMemoryArena(arenaSize);
+
+	Image2DLod heightMap = pushImage2DLod(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, f32);
+	Image2DLod scalar = pushImage2DLod(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, u32);
+	Image2DLod simd = pushImage2DLod(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, u32);
+	Image2DLod tiled = pushImage2DLod(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, u32);
+	Image2D grad = pushImage2D(&arena, 64, 64, v2);
+	fillWithRandomGradients(&grad, 2345);
+	clearImage2D(&heightMap.lod[0]);
+	PerlinOctave octaves[PERLIN_MAX_OCTAVE_COUNT];
+	u32 octaveCount = getPerlinOctaves(octaves, &grad, BENCHMARK_PERLIN_MAX_TILE_SIZE, 0.4f);
+	addPerlinNoiseOctavesSIMD(&heightMap.lod[0], octaves, octaveCount);
+	generateMipLevels1F32SIMD(queue, &heightMap);
+
+	f32 scalarTime = 1e10f;
+	f32 simdTime = 1e10f;
+	f32 tiledTime = 1e10f;
+	for (u32 repeatIndex = 0; repeatIndex < BENCHMARK_IMAGE_REPEAT_COUNT; ++repeatIndex)
+	{
+		LARGE_INTEGER start = Win32GetWallClock();
+		for (u32 lod = 0; lod < heightMap.lodCount; ++lod)
+		{
+			fillNormalMapForHeightMap(&heightMap.lod[lod], &scalar.lod[lod]);
+		}
+		LARGE_INTEGER scalarEnd = Win32GetWallClock();
+		for (u32 lod = 0; lod < heightMap.lodCount; ++lod)
+		{
+			fillNormalMapForHeightMapSIMD(&heightMap.lod[lod], &simd.lod[lod]);
+		}
+		LARGE_INTEGER simdEnd = Win32GetWallClock();
+		fillNormalMapsForHeightMapSIMD(queue, &heightMap, &tiled);
+		LARGE_INTEGER tiledEnd = Win32GetWallClock();
+
+		scalarTime = MIN(scalarTime, 1000.f * Win32GetSecondsElapsed(start, scalarEnd));
+		simdTime = MIN(simdTime, 1000.f * Win32GetSecondsElapsed(scalarEnd, simdEnd));
+		tiledTime = MIN(tiledTime, 1000.f * Win32GetSecondsElapsed(simdEnd, tiledEnd));
+	}
+
+	//NOTE: both the untiled and the tiled run are checked against the scalar version
+	Image2DLod* results[] = { &simd, &tiled };
+	u32 maxDiffs[ARRAY_SIZE(results)] = {};
+	for (u32 resultIndex = 0; resultIndex < ARRAY_SIZE(results); ++resultIndex)
+	{
+		for (u32 lod = 0; lod < heightMap.lodCount; ++lod)
+		{
+			Image2D* expected = &scalar.lod[lod];
+			Image2D* actual = &results[resultIndex]->lod[lod];
+			for (u32 y = 0; y < actual->height; ++y)
+			{
+				u8* expectedChannel = expected->memory + y * expected->pitch;
+				u8* actualChannel = actual->memory + y * actual->pitch;
+				for (u32 x = 0; x < actual->width * 4; ++x)
+				{
+					maxDiffs[resultIndex] = MAX(maxDiffs[resultIndex], (u32)abs((s32)expectedChannel[x] - (s32)actualChannel[x]));
+				}
+			}
+		}
+		ASSERT(maxDiffs[resultIndex] <= 1);
+	}
+
+	sprintf_s(buff, "Normal maps, %u lods from %ux%u\n         ms  max diff\n scalar %8.2f\n simd   %8.2f %9u\n tiled  %8.2f %9u\n",
+		heightMap.lodCount, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, scalarTime, simdTime, maxDiffs[0], tiledTime, maxDiffs[1]);
+	OutputDebugStringA(buff);
+
+	VirtualFree(arena.base, 0, MEM_RELEASE);
+}
+
+static void benchmarkPerlinNormals()
+{
+	//NOTE: the noise and then the normals from the heights against both in one sweep. The heights have to be the same, the normals differ
+	// where the finite differences can't follow the fine octaves
+	char buff[256];
+	umm arenaSize = 256 * 1024 * 1024;
+	MemoryArena arena = createGrowableMemoryArena(arenaSize);
+
+	Image2D separateHeight = pushImage2D(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, f32);
+	Image2D separateNormal = pushImage2D(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, u32);
+	Image2D fusedHeight = pushImage2D(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, f32);
+	Image2D fusedNormal = pushImage2D(&arena, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, u32);
+	Image2D grad = pushImage2D(&arena, 64, 64, v2);
+	fillWithRandomGradients(&grad, 3456);
+
+	PerlinOctave octaves[PERLIN_MAX_OCTAVE_COUNT];
+	u32 octaveCount = getPerlinOctaves(octaves, &grad, BENCHMARK_PERLIN_MAX_TILE_SIZE, 0.4f);
+
+	f32 separateTime = 1e10f;
+	f32 fusedTime = 1e10f;
+	for (u32 repeatIndex = 0; repeatIndex < BENCHMARK_IMAGE_REPEAT_COUNT; ++repeatIndex)
+	{
+		clearImage2D(&separateHeight);
+		clearImage2D(&fusedHeight);
+
+		LARGE_INTEGER start = Win32GetWallClock();
+		addPerlinNoiseOctavesSIMD(&separateHeight, octaves, octaveCount);
+		fillNormalMapForHeightMapSIMD(&separateHeight, &separateNormal);
+		LARGE_INTEGER separateEnd = Win32GetWallClock();
+		addPerlinNoiseOctavesWithNormalsSIMD(&fusedHeight, octaves, octaveCount, &fusedNormal);
+		LARGE_INTEGER fusedEnd = Win32GetWallClock();
+
+		separateTime = MIN(separateTime, 1000.f * Win32GetSecondsElapsed(start, separateEnd));
+		fusedTime = MIN(fusedTime, 1000.f * Win32GetSecondsElapsed(separateEnd, fusedEnd));
+	}
+
+	u64 normalDiffSum = 0;
+	for (u32 y = 0; y < BENCHMARK_IMAGE_SIZE; ++y)
+	{
+		ASSERT(memcmp(separateHeight.memory + y * separateHeight.pitch, fusedHeight.memory + y * fusedHeight.pitch, BENCHMARK_IMAGE_SIZE * sizeof(f32)) == 0);
+		u8* separateChannel = separateNormal.memory + y * separateNormal.pitch;
+		u8* fusedChannel = fusedNormal.memory + y * fusedNormal.pitch;
+		for (u32 x = 0; x < BENCHMARK_IMAGE_SIZE * 4; ++x)
+		{
+			normalDiffSum += (u32)abs((s32)separateChannel[x] - (s32)fusedChannel[x]);
+		}
+	}
+	f32 meanNormalDiff = (f32)normalDiffSum / (f32)(BENCHMARK_IMAGE_SIZE * BENCHMARK_IMAGE_SIZE * 4);
+
+	sprintf_s(buff, "Perlin noise with normals, %u octaves on %ux%u (mean channel diff %.2f)\n           ms\n separate %8.2f\n fused    %8.2f\n",
+		octaveCount, BENCHMARK_IMAGE_SIZE, BENCHMARK_IMAGE_SIZE, meanNormalDiff, separateTime, fusedTime);
+	OutputDebugStringA(buff);
+
+	VirtualFree(arena.base, 0, MEM_RELEASE);
+}
+
+static void runBenchmarks()
+{
+	benchmarkWorkQueues();
+	benchmarkMutexes();
+
+	//NOTE: one queue for all the kernel benchmarks, its threads are left behind, like in benchmarkWorkQueues
+	WorkQueue* queue = (WorkQueue*)VirtualAlloc(0, sizeof(WorkQueue), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	initWorkQueue(queue, CLAMP(1, WORK_QUEUE_MAX_THREAD_COUNT, getLogicalProcessorCount() - 1));
+
+	benchmarkLargePages(queue);
+	benchmarkGrowableArena();
+	benchmarkConcurrentArena();
+	benchmarkMemoryPool();
+	benchmarkPerlinOctaves();
+	benchmarkColorMipLevels(queue);
+	benchmarkNormalMaps(queue);
+	benchmarkPerlinNormals();
+}
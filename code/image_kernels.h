@@ -0,0 +1,741 @@
+//NOTE: no include guard, main.cpp includes this once per instruction set with LANE_WIDTH set, every kernel gets the
+// suffix of its instruction set. The rows have to be padded to a whole lane, the pitch alignment of the images is more than enough
+
+#if LANE_WIDTH == 4
+#define KERNEL(name) name##SSE2
+#define lane_f32 lane_f32x4
+#define lane_s32 lane_s32x4
+#define laneF32 laneF32x4
+#define laneS32 laneS32x4
+#define laneIndexF32 laneIndexF32x4
+#define loadLaneF32 loadLaneF32x4
+#define loadUnalignedLaneF32 loadUnalignedLaneF32x4
+#define loadLaneS32 loadLaneS32x4
+#elif LANE_WIDTH == 8
+#define KERNEL(name) name##AVX2
+#define lane_f32 lane_f32x8
+#define lane_s32 lane_s32x8
+#define laneF32 laneF32x8
+#define laneS32 laneS32x8
+#define laneIndexF32 laneIndexF32x8
+#define loadLaneF32 loadLaneF32x8
+#define loadUnalignedLaneF32 loadUnalignedLaneF32x8
+#define loadLaneS32 loadLaneS32x8
+#elif LANE_WIDTH == 16
+#define KERNEL(name) name##AVX512
+#define lane_f32 lane_f32x16
+#define lane_s32 lane_s32x16
+#define laneF32 laneF32x16
+#define laneS32 laneS32x16
+#define laneIndexF32 laneIndexF32x16
+#define loadLaneF32 loadLaneF32x16
+#define loadUnalignedLaneF32 loadUnalignedLaneF32x16
+#define loadLaneS32 loadLaneS32x16
+#else
+#error "LANE_WIDTH has to be 4, 8 or 16"
+#endif
+
+inline lane_f32 lerp(lane_f32 a, lane_f32 b, lane_f32 t)
+{
+	return a + t * (b - a);
+}
+
+inline lane_f32 smoothBlend2Weight(lane_f32 t)
+{
+	return t * t*t*(laneF32(10.f) + t * (laneF32(6.f)*t - laneF32(15.f)));
+}
+
+inline lane_f32 smoothBlend2WeightDerivative(lane_f32 t)
+{
+	//NOTE: 30t^2(t - 1)^2
+	lane_f32 t1 = t - laneF32(1.f);
+	return laneF32(30.f) * t * t * t1 * t1;
+}
+
+inline lane_f32 smoothBlend2(lane_f32 a, lane_f32 b, lane_f32 t)
+{
+	lane_f32 s = smoothBlend2Weight(t);
+	return a + s * (b - a);
+}
+
+inline void KERNEL(assertClipRect)(Image2D* image, ClipRect* clipRect)
+{
+	ASSERT(image->pitch % sizeof(lane_f32) == 0);
+	if (clipRect)
+	{
+		ASSERT(clipRect->minX % LANE_WIDTH == 0);
+		ASSERT(clipRect->maxX % LANE_WIDTH == 0 || clipRect->maxX >= image->width);
+	}
+}
+
+struct KERNEL(PerlinOctaveRow)
+{
+	u8* gradMemory;
+	lane_s32 gradUMask;
+	lane_f32 gradAlignX;
+	lane_f32 tileSizeScale;
+	lane_f32 scale;
+	lane_s32 v0Offset;
+	lane_s32 v1Offset;
+	lane_f32 dv;
+	lane_f32 sv; //smoothBlend2Weight(dv)
+	lane_f32 dsv; //smoothBlend2WeightDerivative(dv), only for the normals
+};
+
+inline lane_f32 perlinNoise(KERNEL(PerlinOctaveRow)* octave, lane_f32 x)
+{
+	lane_f32 u = (x - octave->gradAlignX) * octave->tileSizeScale;
+	lane_s32 u0 = floorToS32(u);
+	lane_s32 u1 = u0 + laneS32(1);
+	lane_f32 du = u - toF32(u0);
+	u0 = (u0 & octave->gradUMask) << 3; //sizeof(v2)
+	u1 = (u1 & octave->gradUMask) << 3;
+
+	u8* gradX = octave->gradMemory;
+	u8* gradY = octave->gradMemory + sizeof(f32);
+	lane_s32 i00 = u0 + octave->v0Offset;
+	lane_s32 i10 = u1 + octave->v0Offset;
+	lane_s32 i01 = u0 + octave->v1Offset;
+	lane_s32 i11 = u1 + octave->v1Offset;
+
+	lane_f32 dv = octave->dv;
+	lane_f32 du1 = du - laneF32(1.f);
+	lane_f32 dv1 = dv - laneF32(1.f);
+	lane_f32 a = smoothBlend2(gatherF32(gradX, i00) * du + gatherF32(gradY, i00) * dv, gatherF32(gradX, i10) * du1 + gatherF32(gradY, i10) * dv, du);
+	lane_f32 b = smoothBlend2(gatherF32(gradX, i01) * du + gatherF32(gradY, i01) * dv1, gatherF32(gradX, i11) * du1 + gatherF32(gradY, i11) * dv1, du);
+	lane_f32 c = a + octave->sv * (b - a);
+	return c;
+}
+
+struct KERNEL(PerlinSample)
+{
+	lane_f32 value;
+	lane_f32 dhdu; //along the grad grid, a tile is 1
+	lane_f32 dhdv;
+};
+
+inline KERNEL(PerlinSample) perlinNoiseWithGradient(KERNEL(PerlinOctaveRow)* octave, lane_f32 x)
+{
+	//NOTE: perlinNoise with the same operations for the value, and the derivatives of the blends by the chain rule
+	lane_f32 u = (x - octave->gradAlignX) * octave->tileSizeScale;
+	lane_s32 u0 = floorToS32(u);
+	lane_s32 u1 = u0 + laneS32(1);
+	lane_f32 du = u - toF32(u0);
+	u0 = (u0 & octave->gradUMask) << 3; //sizeof(v2)
+	u1 = (u1 & octave->gradUMask) << 3;
+
+	u8* gradX = octave->gradMemory;
+	u8* gradY = octave->gradMemory + sizeof(f32);
+	lane_s32 i00 = u0 + octave->v0Offset;
+	lane_s32 i10 = u1 + octave->v0Offset;
+	lane_s32 i01 = u0 + octave->v1Offset;
+	lane_s32 i11 = u1 + octave->v1Offset;
+
+	lane_f32 gx00 = gatherF32(gradX, i00);
+	lane_f32 gy00 = gatherF32(gradY, i00);
+	lane_f32 gx10 = gatherF32(gradX, i10);
+	lane_f32 gy10 = gatherF32(gradY, i10);
+	lane_f32 gx01 = gatherF32(gradX, i01);
+	lane_f32 gy01 = gatherF32(gradY, i01);
+	lane_f32 gx11 = gatherF32(gradX, i11);
+	lane_f32 gy11 = gatherF32(gradY, i11);
+
+	lane_f32 dv = octave->dv;
+	lane_f32 du1 = du - laneF32(1.f);
+	lane_f32 dv1 = dv - laneF32(1.f);
+	lane_f32 n00 = gx00 * du + gy00 * dv;
+	lane_f32 n10 = gx10 * du1 + gy10 * dv;
+	lane_f32 n01 = gx01 * du + gy01 * dv1;
+	lane_f32 n11 = gx11 * du1 + gy11 * dv1;
+
+	lane_f32 su = smoothBlend2Weight(du);
+	lane_f32 sv = octave->sv;
+	lane_f32 a = n00 + su * (n10 - n00);
+	lane_f32 b = n01 + su * (n11 - n01);
+
+	lane_f32 dsu = smoothBlend2WeightDerivative(du);
+	lane_f32 dsv = octave->dsv;
+	lane_f32 dadu = gx00 + dsu * (n10 - n00) + su * (gx10 - gx00);
+	lane_f32 dadv = gy00 + su * (gy10 - gy00);
+	lane_f32 dbdu = gx01 + dsu * (n11 - n01) + su * (gx11 - gx01);
+	lane_f32 dbdv = gy01 + su * (gy11 - gy01);
+
+	KERNEL(PerlinSample) result;
+	result.value = a + sv * (b - a);
+	result.dhdu = dadu + sv * (dbdu - dadu);
+	result.dhdv = dadv + dsv * (b - a) + sv * (dbdv - dadv);
+	return result;
+}
+
+static void KERNEL(initPerlinOctaveRows)(KERNEL(PerlinOctaveRow)* octaveRows, PerlinOctave* octaves, u32 octaveCount)
+{
+	for (u32 octaveIndex = 0; octaveIndex < octaveCount; ++octaveIndex)
+	{
+		PerlinOctave* octave = octaves + octaveIndex;
+		ASSERT(IS_POW2(octave->grad->width) && IS_POW2(octave->grad->height));
+
+		KERNEL(PerlinOctaveRow)* octaveRow = octaveRows + octaveIndex;
+		octaveRow->gradMemory = octave->grad->memory;
+		octaveRow->gradUMask = laneS32(octave->grad->width - 1);
+		octaveRow->gradAlignX = laneF32((f32)octave->gradAlignX - 0.5f);
+		octaveRow->tileSizeScale = laneF32(1.f / (f32)octave->tileSize);
+		octaveRow->scale = laneF32(octave->heightScale);
+	}
+}
+
+inline void KERNEL(setPerlinOctaveRows)(KERNEL(PerlinOctaveRow)* octaveRows, PerlinOctave* octaves, u32 octaveCount, u32 y)
+{
+	//NOTE: v is the same for the whole row
+	for (u32 octaveIndex = 0; octaveIndex < octaveCount; ++octaveIndex)
+	{
+		PerlinOctave* octave = octaves + octaveIndex;
+		KERNEL(PerlinOctaveRow)* octaveRow = octaveRows + octaveIndex;
+
+		f32 v = ((f32)y - ((f32)octave->gradAlignY - 0.5f)) * (1.f / (f32)octave->tileSize);
+		s32 v0 = (s32)floorf(v);
+		s32 v1 = v0 + 1;
+		octaveRow->dv = laneF32(v - (f32)v0);
+		octaveRow->sv = smoothBlend2Weight(octaveRow->dv);
+		octaveRow->dsv = smoothBlend2WeightDerivative(octaveRow->dv);
+		octaveRow->v0Offset = laneS32((v0 & (octave->grad->height - 1)) * octave->grad->pitch);
+		octaveRow->v1Offset = laneS32((v1 & (octave->grad->height - 1)) * octave->grad->pitch);
+	}
+}
+
+static v2 KERNEL(addPerlinNoiseOctaves)(Image2D* image, PerlinOctave* octaves, u32 octaveCount, ClipRect* clipRect)
+{
+	//NOTE: every octave is summed for a lane of pixels in a register before the pixels are written back, so the image is read and written once
+	// instead of once per octave. The octaves are added in order, the result is the same as one addPerlinNoiseSIMD per octave
+	ASSERT(octaveCount <= PERLIN_MAX_OCTAVE_COUNT);
+	KERNEL(assertClipRect)(image, clipRect);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : image->width;
+	u32 maxY = clipRect ? clipRect->maxY : image->height;
+
+	lane_f32 minValue = laneF32(1e10f);
+	lane_f32 maxValue = laneF32(-1e10f);
+
+	KERNEL(PerlinOctaveRow) octaveRows[PERLIN_MAX_OCTAVE_COUNT];
+	KERNEL(initPerlinOctaveRows)(octaveRows, octaves, octaveCount);
+
+	lane_f32 laneIndex = laneIndexF32();
+
+	u8* row = image->memory + minX * sizeof(f32) + minY * image->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		KERNEL(setPerlinOctaveRows)(octaveRows, octaves, octaveCount, y);
+
+		f32* pixel = (f32*)row;
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_f32 pixelValue = loadLaneF32(pixel);
+
+			lane_f32 pixelX = laneF32((f32)x) + laneIndex;
+			for (u32 octaveIndex = 0; octaveIndex < octaveCount; ++octaveIndex)
+			{
+				KERNEL(PerlinOctaveRow)* octaveRow = octaveRows + octaveIndex;
+				pixelValue = pixelValue + octaveRow->scale * perlinNoise(octaveRow, pixelX);
+			}
+
+			minValue = laneMin(pixelValue, minValue);
+			maxValue = laneMax(pixelValue, maxValue);
+
+			storeLane(pixel, pixelValue);
+			pixel += LANE_WIDTH;
+		}
+		row += image->pitch;
+	}
+
+	v2 result = { horizontalMin(minValue), horizontalMax(maxValue) };
+	return result;
+}
+
+static void KERNEL(downsample2x2F32)(Image2D* dest, Image2D* src, ClipRect* clipRect)
+{
+	//NOTE: an exact halving, the bilinear sample at the middle of a 2x2 block is the average of the block. The source rows are
+	// loaded contiguously and the neighbours are summed pairwise, no gather is needed
+	ASSERT(src->width == 2 * dest->width && src->height == 2 * dest->height);
+	KERNEL(assertClipRect)(dest, clipRect);
+	ASSERT(src->pitch % sizeof(lane_f32) == 0);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : dest->width;
+	u32 maxY = clipRect ? clipRect->maxY : dest->height;
+
+	lane_f32 quarter = laneF32(0.25f);
+
+	u8* destRow = dest->memory + minX * sizeof(f32) + minY * dest->pitch;
+	u8* srcRow = src->memory + 2 * minX * sizeof(f32) + 2 * minY * src->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		f32* destPixel = (f32*)destRow;
+		f32* topPixel = (f32*)srcRow;
+		f32* bottomPixel = (f32*)(srcRow + src->pitch);
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_f32 top = pairwiseSum(loadLaneF32(topPixel), loadLaneF32(topPixel + LANE_WIDTH));
+			lane_f32 bottom = pairwiseSum(loadLaneF32(bottomPixel), loadLaneF32(bottomPixel + LANE_WIDTH));
+			storeLane(destPixel, (top + bottom) * quarter);
+
+			destPixel += LANE_WIDTH;
+			topPixel += 2 * LANE_WIDTH;
+			bottomPixel += 2 * LANE_WIDTH;
+		}
+		destRow += dest->pitch;
+		srcRow += 2 * src->pitch;
+	}
+}
+
+static void KERNEL(resampleBilinear1F32)(Image2D* dest, Image2D* src, ClipRect* clipRect)
+{
+	//NOTE: any size to any size, the four texels of a pixel can be anywhere, so they are gathered
+	KERNEL(assertClipRect)(dest, clipRect);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : dest->width;
+	u32 maxY = clipRect ? clipRect->maxY : dest->height;
+
+	lane_f32 laneIndex = laneIndexF32();
+	lane_f32 destWidth = laneF32((f32)dest->width);
+	lane_f32 srcWidth = laneF32((f32)src->width);
+	lane_s32 maxU = laneS32(src->width - 1);
+
+	u8* row = dest->memory + minX * sizeof(f32) + minY * dest->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		f32 v = ((f32)y + 0.5f) / (f32)dest->height;
+		SampleParams1D paramsV = getSampleParams(src->height, v);
+		lane_s32 v0Offset = laneS32(paramsV.u0 * src->pitch);
+		lane_s32 v1Offset = laneS32(paramsV.u1 * src->pitch);
+		lane_f32 dv = laneF32(paramsV.du);
+
+		f32* pixel = (f32*)row;
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_f32 pixelX = laneF32((f32)x) + laneIndex;
+
+			//NOTE: the same as getSampleParams, a lane at a time
+			lane_f32 u = (pixelX + laneF32(0.5f)) / destWidth;
+			u = u * srcWidth - laneF32(0.5f);
+			lane_s32 u0 = floorToS32(u);
+			lane_s32 u1 = u0 + laneS32(1);
+			u0 = laneMax(laneMin(maxU, u0), laneS32(0));
+			u1 = laneMax(laneMin(maxU, u1), laneS32(0));
+			lane_f32 du = u - toF32(u0);
+
+			u0 = u0 << 2; //sizeof(f32)
+			u1 = u1 << 2;
+			lane_f32 c00 = gatherF32(src->memory, u0 + v0Offset);
+			lane_f32 c10 = gatherF32(src->memory, u1 + v0Offset);
+			lane_f32 c01 = gatherF32(src->memory, u0 + v1Offset);
+			lane_f32 c11 = gatherF32(src->memory, u1 + v1Offset);
+
+			lane_f32 a = lerp(c00, c10, du);
+			lane_f32 b = lerp(c01, c11, du);
+			lane_f32 c = lerp(a, b, dv);
+
+			storeLane(pixel, c);
+			pixel += LANE_WIDTH;
+		}
+		row += dest->pitch;
+	}
+}
+
+inline lane_f32 unpackColorChannel(lane_s32 texels, s32 shift, b32 srgb)
+{
+	//NOTE: the same as unpackColor and unpackColorSrgb, one channel of a lane of texels
+	lane_s32 channel = (texels >> shift) & laneS32(255);
+	if (srgb)
+	{
+		return gatherF32((u8*)g_srgbToLinear, channel << 2); //sizeof(f32)
+	}
+	return toF32(channel) * laneF32(1.f / 255.f);
+}
+
+inline lane_s32 packColorChannel(lane_f32 value, s32 shift, b32 srgb)
+{
+	//NOTE: the same as packColor and packColorSrgb, truncated like them
+	value = laneMin(laneMax(value, laneF32(0.f)), laneF32(1.f));
+	lane_s32 channel;
+	if (srgb)
+	{
+		lane_s32 index = truncateToS32(value * laneF32((f32)(SRGB_ENCODE_TABLE_SIZE - 1)) + laneF32(0.5f));
+		channel = gatherS32((u8*)g_linearToSrgb, index << 2); //sizeof(u32)
+	}
+	else
+	{
+		channel = truncateToS32(value * laneF32(255.f));
+	}
+	return channel << shift;
+}
+
+static void KERNEL(downsample2x2U8x4)(Image2D* dest, Image2D* src, b32 srgb, ClipRect* clipRect)
+{
+	//NOTE: an exact halving. Without sRGB it stays in integers, the channels of a texel are split into the (r, b) and the (g, a) 16 bit
+	// fields, the sum of four texels fits in them, so a field pair is averaged with one add and one shift. sRGB has to be averaged
+	// in linear space, that goes through floats.
+	// Not bit for bit generateMipLevels4U8: the integer average is the exact floor of the mean, the nested float lerps there
+	// truncate to one below it for some whole number means, and their weights are only close to 0.5 for odd widths
+	ASSERT(src->width == 2 * dest->width && src->height == 2 * dest->height);
+	KERNEL(assertClipRect)(dest, clipRect);
+	ASSERT(src->pitch % sizeof(lane_s32) == 0);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : dest->width;
+	u32 maxY = clipRect ? clipRect->maxY : dest->height;
+
+	lane_s32 fieldMask = laneS32(0x00ff00ff);
+	lane_f32 quarter = laneF32(0.25f);
+
+	u8* destRow = dest->memory + minX * sizeof(u32) + minY * dest->pitch;
+	u8* srcRow = src->memory + 2 * minX * sizeof(u32) + 2 * minY * src->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		u32* destPixel = (u32*)destRow;
+		u32* topPixel = (u32*)srcRow;
+		u32* bottomPixel = (u32*)(srcRow + src->pitch);
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_s32 top0 = loadLaneS32(topPixel);
+			lane_s32 top1 = loadLaneS32(topPixel + LANE_WIDTH);
+			lane_s32 bottom0 = loadLaneS32(bottomPixel);
+			lane_s32 bottom1 = loadLaneS32(bottomPixel + LANE_WIDTH);
+
+			lane_s32 color;
+			if (srgb)
+			{
+				color = laneS32(0);
+				for (s32 shift = 0; shift < 32; shift += 8)
+				{
+					b32 channelSrgb = shift < 24; //alpha is linear
+					lane_f32 sum0 = unpackColorChannel(top0, shift, channelSrgb) + unpackColorChannel(bottom0, shift, channelSrgb);
+					lane_f32 sum1 = unpackColorChannel(top1, shift, channelSrgb) + unpackColorChannel(bottom1, shift, channelSrgb);
+					color = color | packColorChannel(pairwiseSum(sum0, sum1) * quarter, shift, channelSrgb);
+				}
+			}
+			else
+			{
+				lane_s32 rb = pairwiseSum((top0 & fieldMask) + (bottom0 & fieldMask), (top1 & fieldMask) + (bottom1 & fieldMask));
+				lane_s32 ga = pairwiseSum(((top0 >> 8) & fieldMask) + ((bottom0 >> 8) & fieldMask), ((top1 >> 8) & fieldMask) + ((bottom1 >> 8) & fieldMask));
+				color = ((rb >> 2) & fieldMask) | (((ga >> 2) & fieldMask) << 8);
+			}
+			storeLane(destPixel, color);
+
+			destPixel += LANE_WIDTH;
+			topPixel += 2 * LANE_WIDTH;
+			bottomPixel += 2 * LANE_WIDTH;
+		}
+		destRow += dest->pitch;
+		srcRow += 2 * src->pitch;
+	}
+}
+
+static void KERNEL(resampleBilinearU8x4)(Image2D* dest, Image2D* src, b32 srgb, ClipRect* clipRect)
+{
+	//NOTE: any size to any size, in floats with the same operations as generateMipLevels4U8, so the result is the same
+	KERNEL(assertClipRect)(dest, clipRect);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : dest->width;
+	u32 maxY = clipRect ? clipRect->maxY : dest->height;
+
+	lane_f32 laneIndex = laneIndexF32();
+	lane_f32 one = laneF32(1.f);
+	lane_f32 destWidth = laneF32((f32)dest->width);
+	lane_f32 srcWidth = laneF32((f32)src->width);
+	lane_s32 maxU = laneS32(src->width - 1);
+
+	u8* row = dest->memory + minX * sizeof(u32) + minY * dest->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		f32 v = ((f32)y + 0.5f) / (f32)dest->height;
+		SampleParams1D paramsV = getSampleParams(src->height, v);
+		lane_s32 v0Offset = laneS32(paramsV.u0 * src->pitch);
+		lane_s32 v1Offset = laneS32(paramsV.u1 * src->pitch);
+		lane_f32 dv = laneF32(paramsV.du);
+		lane_f32 dv0 = laneF32(1.f - paramsV.du);
+
+		u32* pixel = (u32*)row;
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_f32 pixelX = laneF32((f32)x) + laneIndex;
+
+			lane_f32 u = (pixelX + laneF32(0.5f)) / destWidth;
+			u = u * srcWidth - laneF32(0.5f);
+			lane_s32 u0 = floorToS32(u);
+			lane_s32 u1 = u0 + laneS32(1);
+			u0 = laneMax(laneMin(maxU, u0), laneS32(0));
+			u1 = laneMax(laneMin(maxU, u1), laneS32(0));
+			lane_f32 du = u - toF32(u0);
+			lane_f32 du0 = one - du;
+
+			u0 = u0 << 2; //sizeof(u32)
+			u1 = u1 << 2;
+			lane_s32 t00 = gatherS32(src->memory, u0 + v0Offset);
+			lane_s32 t10 = gatherS32(src->memory, u1 + v0Offset);
+			lane_s32 t01 = gatherS32(src->memory, u0 + v1Offset);
+			lane_s32 t11 = gatherS32(src->memory, u1 + v1Offset);
+
+			lane_s32 color = laneS32(0);
+			for (s32 shift = 0; shift < 32; shift += 8)
+			{
+				b32 channelSrgb = srgb && shift < 24; //alpha is linear
+				//NOTE: the lerps of math.h, (1 - t)*a + t*b
+				lane_f32 a = du0 * unpackColorChannel(t00, shift, channelSrgb) + du * unpackColorChannel(t10, shift, channelSrgb);
+				lane_f32 b = du0 * unpackColorChannel(t01, shift, channelSrgb) + du * unpackColorChannel(t11, shift, channelSrgb);
+				lane_f32 c = dv0 * a + dv * b;
+				color = color | packColorChannel(c, shift, channelSrgb);
+			}
+
+			storeLane(pixel, color);
+			pixel += LANE_WIDTH;
+		}
+		row += dest->pitch;
+	}
+}
+
+inline lane_s32 packNormal(lane_f32 x, lane_f32 y)
+{
+	//NOTE: packNormal of (x, y, 1)
+	lane_f32 half = laneF32(0.5f);
+	lane_f32 invLength = reciprocalSqrt(x * x + y * y + laneF32(1.f));
+	lane_s32 color = laneS32((s32)0xff000000);
+	color = color | packColorChannel(x * invLength * half + half, 0, false);
+	color = color | packColorChannel(y * invLength * half + half, 8, false);
+	color = color | packColorChannel(invLength * half + half, 16, false);
+	return color;
+}
+
+static void KERNEL(fillNormalMap)(Image2D* heightMap, Image2D* normalMap, ClipRect* clipRect)
+{
+	//NOTE: the same normals as fillNormalMapForHeightMap, the rows above and below are wrapped once per row, the columns only in the
+	// lanes touching the left or the right edge, the other lanes load their neighbours unaligned. The halo of a tile is read
+	// from the height map directly, nothing else writes it
+	ASSERT(heightMap->width == normalMap->width && heightMap->height == normalMap->height);
+	KERNEL(assertClipRect)(normalMap, clipRect);
+	ASSERT(heightMap->pitch % sizeof(lane_f32) == 0);
+
+	u32 width = heightMap->width;
+	u32 height = heightMap->height;
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : width;
+	u32 maxY = clipRect ? clipRect->maxY : height;
+
+	lane_f32 scaleX = laneF32(-0.5f * (f32)width); //-1 / (2 * pixelSize)
+	lane_f32 scaleY = laneF32(-0.5f * (f32)height);
+	lane_s32 laneIndex = truncateToS32(laneIndexF32());
+	lane_s32 laneWidth = laneS32(width);
+	lane_s32 maxU = laneS32(width - 1);
+
+	u8* normalRow = normalMap->memory + minX * sizeof(u32) + minY * normalMap->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		u32 y0 = y == 0 ? height - 1 : y - 1;
+		u32 y1 = y + 1 == height ? 0 : y + 1;
+		f32* row = (f32*)(heightMap->memory + y * heightMap->pitch);
+		f32* rowAbove = (f32*)(heightMap->memory + y0 * heightMap->pitch);
+		f32* rowBelow = (f32*)(heightMap->memory + y1 * heightMap->pitch);
+
+		u32* normal = (u32*)normalRow;
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_f32 left;
+			lane_f32 right;
+			if (x > 0 && x + LANE_WIDTH < width)
+			{
+				left = loadUnalignedLaneF32(row + x - 1);
+				right = loadUnalignedLaneF32(row + x + 1);
+			}
+			else
+			{
+				//NOTE: the sign of u - 1 and u + 1 - width tells where to wrap, the lanes past the width write into the padding
+				lane_s32 u = laneMin(laneS32(x) + laneIndex, maxU);
+				lane_s32 u0 = u - laneS32(1);
+				u0 = u0 + (laneWidth & (u0 >> 31));
+				lane_s32 u1 = u + laneS32(1);
+				u1 = u1 & ((u1 - laneWidth) >> 31);
+				left = gatherF32((u8*)row, u0 << 2); //sizeof(f32)
+				right = gatherF32((u8*)row, u1 << 2);
+			}
+			lane_f32 above = loadLaneF32(rowAbove + x);
+			lane_f32 below = loadLaneF32(rowBelow + x);
+
+			storeLane(normal, packNormal((right - left) * scaleX, (below - above) * scaleY));
+
+			normal += LANE_WIDTH;
+		}
+		normalRow += normalMap->pitch;
+	}
+}
+
+static v2 KERNEL(addPerlinNoiseOctavesWithNormals)(Image2D* image, PerlinOctave* octaves, u32 octaveCount, Image2D* normalMap, ClipRect* clipRect)
+{
+	//NOTE: addPerlinNoiseOctaves, the heights come out the same, and the derivatives of the octaves are summed next to them, so the normal map
+	// is written in the same sweep. The normals are the exact ones of the added noise, the image is expected to be cleared before
+	ASSERT(octaveCount <= PERLIN_MAX_OCTAVE_COUNT);
+	ASSERT(image->width == normalMap->width && image->height == normalMap->height);
+	KERNEL(assertClipRect)(image, clipRect);
+	ASSERT(normalMap->pitch % sizeof(lane_s32) == 0);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : image->width;
+	u32 maxY = clipRect ? clipRect->maxY : image->height;
+
+	lane_f32 minValue = laneF32(1e10f);
+	lane_f32 maxValue = laneF32(-1e10f);
+
+	KERNEL(PerlinOctaveRow) octaveRows[PERLIN_MAX_OCTAVE_COUNT];
+	KERNEL(initPerlinOctaveRows)(octaveRows, octaves, octaveCount);
+
+	//NOTE: from the grid to (-dh/dx, -dh/dy) in the units of fillNormalMap, where the image is 1 wide
+	lane_f32 normalScaleX[PERLIN_MAX_OCTAVE_COUNT];
+	lane_f32 normalScaleY[PERLIN_MAX_OCTAVE_COUNT];
+	for (u32 octaveIndex = 0; octaveIndex < octaveCount; ++octaveIndex)
+	{
+		PerlinOctave* octave = octaves + octaveIndex;
+		f32 slope = octave->heightScale / (f32)octave->tileSize;
+		normalScaleX[octaveIndex] = laneF32(-slope * (f32)image->width);
+		normalScaleY[octaveIndex] = laneF32(-slope * (f32)image->height);
+	}
+
+	lane_f32 laneIndex = laneIndexF32();
+
+	u8* row = image->memory + minX * sizeof(f32) + minY * image->pitch;
+	u8* normalRow = normalMap->memory + minX * sizeof(u32) + minY * normalMap->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		KERNEL(setPerlinOctaveRows)(octaveRows, octaves, octaveCount, y);
+
+		f32* pixel = (f32*)row;
+		u32* normal = (u32*)normalRow;
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_f32 pixelValue = loadLaneF32(pixel);
+			lane_f32 nx = laneF32(0.f);
+			lane_f32 ny = laneF32(0.f);
+
+			lane_f32 pixelX = laneF32((f32)x) + laneIndex;
+			for (u32 octaveIndex = 0; octaveIndex < octaveCount; ++octaveIndex)
+			{
+				KERNEL(PerlinOctaveRow)* octaveRow = octaveRows + octaveIndex;
+				KERNEL(PerlinSample) sample = perlinNoiseWithGradient(octaveRow, pixelX);
+				pixelValue = pixelValue + octaveRow->scale * sample.value;
+				nx = nx + normalScaleX[octaveIndex] * sample.dhdu;
+				ny = ny + normalScaleY[octaveIndex] * sample.dhdv;
+			}
+
+			minValue = laneMin(pixelValue, minValue);
+			maxValue = laneMax(pixelValue, maxValue);
+
+			storeLane(pixel, pixelValue);
+			storeLane(normal, packNormal(nx, ny));
+			pixel += LANE_WIDTH;
+			normal += LANE_WIDTH;
+		}
+		row += image->pitch;
+		normalRow += normalMap->pitch;
+	}
+
+	v2 result = { horizontalMin(minValue), horizontalMax(maxValue) };
+	return result;
+}
+
+static void KERNEL(scaleImage)(Image2D* image, v2 fromScale, v2 toScale, ClipRect* clipRect)
+{
+	KERNEL(assertClipRect)(image, clipRect);
+
+	f32 _a = (toScale.y - toScale.x) / (fromScale.y - fromScale.x);
+	f32 _b = toScale.x - _a * fromScale.x;
+
+	lane_f32 a = laneF32(_a);
+	lane_f32 b = laneF32(_b);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : image->width;
+	u32 maxY = clipRect ? clipRect->maxY : image->height;
+
+	u8* row = image->memory + minX * sizeof(f32) + minY * image->pitch;
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		f32* pixel = (f32*)row;
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			storeLane(pixel, a * loadLaneF32(pixel) + b);
+			pixel += LANE_WIDTH;
+		}
+		row += image->pitch;
+	}
+}
+
+static void KERNEL(combineGrayScaledImages)(Image2D* dest, Image2D* red, Image2D* green, Image2D* blue, ClipRect* clipRect)
+{
+	//make sky colored, use fractal height and normal map for sphere, 3D perlin noise
+
+	ASSERT(dest->width == red->width && dest->width == green->width && dest->width == blue->width);
+	ASSERT(dest->height == red->height && dest->height == green->height && dest->height == blue->height);
+
+	KERNEL(assertClipRect)(dest, clipRect);
+	ASSERT(red->pitch % sizeof(lane_f32) == 0);
+	ASSERT(green->pitch % sizeof(lane_f32) == 0);
+	ASSERT(blue->pitch % sizeof(lane_f32) == 0);
+
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : dest->width;
+	u32 maxY = clipRect ? clipRect->maxY : dest->height;
+
+	u8* destRow = dest->memory + minX * sizeof(u32) + minY * dest->pitch;
+	u8* redRow = red->memory + minX * sizeof(f32) + minY * red->pitch;
+	u8* greenRow = green->memory + minX * sizeof(f32) + minY * green->pitch;
+	u8* blueRow = blue->memory + minX * sizeof(f32) + minY * blue->pitch;
+
+	lane_s32 alpha = laneS32(/*255*/0 << 24);
+	lane_f32 zero = laneF32(0.f);
+	lane_f32 maxChannel = laneF32(255.f);
+
+	for (u32 y = minY; y < maxY; ++y)
+	{
+		u32* destPixel = (u32*)destRow;
+		f32* redPixel = (f32*)redRow;
+		f32* greenPixel = (f32*)greenRow;
+		f32* bluePixel = (f32*)blueRow;
+		for (u32 x = minX; x < maxX; x += LANE_WIDTH)
+		{
+			lane_f32 rf = laneMax(zero, laneMin(maxChannel, loadLaneF32(redPixel) * maxChannel));
+			lane_f32 gf = laneMax(zero, laneMin(maxChannel, loadLaneF32(greenPixel) * maxChannel));
+			lane_f32 bf = laneMax(zero, laneMin(maxChannel, loadLaneF32(bluePixel) * maxChannel));
+
+			lane_s32 color = roundToS32(rf) | (roundToS32(gf) << 8) | (roundToS32(bf) << 16) | alpha;
+			storeLane(destPixel, color);
+
+			destPixel += LANE_WIDTH;
+			redPixel += LANE_WIDTH;
+			greenPixel += LANE_WIDTH;
+			bluePixel += LANE_WIDTH;
+		}
+		destRow += dest->pitch;
+		redRow += red->pitch;
+		greenRow += green->pitch;
+		blueRow += blue->pitch;
+	}
+}
+
+#undef KERNEL
+#undef lane_f32
+#undef lane_s32
+#undef laneF32
+#undef laneS32
+#undef laneIndexF32
+#undef loadLaneF32
+#undef loadUnalignedLaneF32
+#undef loadLaneS32
@@ -0,0 +1,569 @@
+#pragma once
+
+#include "platform.h"
+
+//NOTE: thin wrappers over the SIMD registers, one set per instruction set, so the image kernels can be written once and
+// compiled for every width (see image_kernels.h). Only plain intrinsics are used, the build targets the x64 baseline,
+// the wider variants are only called after the cpu check
+
+//SSE2, 4 lanes
+struct lane_f32x4
+{
+	__m128 v;
+};
+
+struct lane_s32x4
+{
+	__m128i v;
+};
+
+inline lane_f32x4 laneF32x4(f32 a)
+{
+	return { _mm_set1_ps(a) };
+}
+
+inline lane_s32x4 laneS32x4(s32 a)
+{
+	return { _mm_set1_epi32(a) };
+}
+
+inline lane_f32x4 laneIndexF32x4()
+{
+	return { _mm_setr_ps(0.f, 1.f, 2.f, 3.f) };
+}
+
+inline lane_f32x4 loadLaneF32x4(f32* a)
+{
+	return { _mm_load_ps(a) };
+}
+
+inline lane_f32x4 loadUnalignedLaneF32x4(f32* a)
+{
+	return { _mm_loadu_ps(a) };
+}
+
+inline lane_s32x4 loadLaneS32x4(u32* a)
+{
+	return { _mm_load_si128((__m128i*)a) };
+}
+
+inline void storeLane(f32* dest, lane_f32x4 a)
+{
+	_mm_store_ps(dest, a.v);
+}
+
+inline void storeLane(u32* dest, lane_s32x4 a)
+{
+	_mm_store_si128((__m128i*)dest, a.v);
+}
+
+inline lane_f32x4 operator+(lane_f32x4 a, lane_f32x4 b)
+{
+	return { _mm_add_ps(a.v, b.v) };
+}
+
+inline lane_f32x4 operator-(lane_f32x4 a, lane_f32x4 b)
+{
+	return { _mm_sub_ps(a.v, b.v) };
+}
+
+inline lane_f32x4 operator*(lane_f32x4 a, lane_f32x4 b)
+{
+	return { _mm_mul_ps(a.v, b.v) };
+}
+
+inline lane_f32x4 operator/(lane_f32x4 a, lane_f32x4 b)
+{
+	return { _mm_div_ps(a.v, b.v) };
+}
+
+inline lane_f32x4 laneMin(lane_f32x4 a, lane_f32x4 b)
+{
+	return { _mm_min_ps(a.v, b.v) };
+}
+
+inline lane_f32x4 laneMax(lane_f32x4 a, lane_f32x4 b)
+{
+	return { _mm_max_ps(a.v, b.v) };
+}
+
+inline lane_f32x4 reciprocalSqrt(lane_f32x4 a)
+{
+	return { _mm_rsqrt_ps(a.v) }; //12 bits of precision, plenty for 8 bit results
+}
+
+inline lane_s32x4 operator+(lane_s32x4 a, lane_s32x4 b)
+{
+	return { _mm_add_epi32(a.v, b.v) };
+}
+
+inline lane_s32x4 operator-(lane_s32x4 a, lane_s32x4 b)
+{
+	return { _mm_sub_epi32(a.v, b.v) };
+}
+
+inline lane_s32x4 operator&(lane_s32x4 a, lane_s32x4 b)
+{
+	return { _mm_and_si128(a.v, b.v) };
+}
+
+inline lane_s32x4 operator|(lane_s32x4 a, lane_s32x4 b)
+{
+	return { _mm_or_si128(a.v, b.v) };
+}
+
+inline lane_s32x4 operator<<(lane_s32x4 a, s32 shift)
+{
+	return { _mm_slli_epi32(a.v, shift) };
+}
+
+inline lane_s32x4 operator>>(lane_s32x4 a, s32 shift)
+{
+	return { _mm_srai_epi32(a.v, shift) };
+}
+
+inline lane_s32x4 laneMin(lane_s32x4 a, lane_s32x4 b)
+{
+	//NOTE: pminsd is SSE4.1
+	__m128i aIsGreater = _mm_cmpgt_epi32(a.v, b.v);
+	return { _mm_or_si128(_mm_and_si128(aIsGreater, b.v), _mm_andnot_si128(aIsGreater, a.v)) };
+}
+
+inline lane_s32x4 laneMax(lane_s32x4 a, lane_s32x4 b)
+{
+	__m128i aIsGreater = _mm_cmpgt_epi32(a.v, b.v);
+	return { _mm_or_si128(_mm_and_si128(aIsGreater, a.v), _mm_andnot_si128(aIsGreater, b.v)) };
+}
+
+inline lane_f32x4 toF32(lane_s32x4 a)
+{
+	return { _mm_cvtepi32_ps(a.v) };
+}
+
+inline lane_s32x4 roundToS32(lane_f32x4 a)
+{
+	return { _mm_cvtps_epi32(a.v) }; //with the default rounding mode, to nearest
+}
+
+inline lane_s32x4 truncateToS32(lane_f32x4 a)
+{
+	return { _mm_cvttps_epi32(a.v) };
+}
+
+inline lane_s32x4 floorToS32(lane_f32x4 a)
+{
+	//NOTE: roundps is SSE4.1, the truncation is one too big for the negative non integers
+	__m128i truncated = _mm_cvttps_epi32(a.v);
+	__m128 tooBig = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), a.v);
+	return { _mm_add_epi32(truncated, _mm_castps_si128(tooBig)) };
+}
+
+inline lane_f32x4 gatherF32(u8* base, lane_s32x4 byteOffset)
+{
+	s32 offsets[4];
+	_mm_storeu_si128((__m128i*)offsets, byteOffset.v);
+	return { _mm_setr_ps(*(f32*)(base + offsets[0]), *(f32*)(base + offsets[1]), *(f32*)(base + offsets[2]), *(f32*)(base + offsets[3])) };
+}
+
+inline lane_s32x4 gatherS32(u8* base, lane_s32x4 byteOffset)
+{
+	s32 offsets[4];
+	_mm_storeu_si128((__m128i*)offsets, byteOffset.v);
+	return { _mm_setr_epi32(*(s32*)(base + offsets[0]), *(s32*)(base + offsets[1]), *(s32*)(base + offsets[2]), *(s32*)(base + offsets[3])) };
+}
+
+inline lane_f32x4 pairwiseSum(lane_f32x4 a, lane_f32x4 b)
+{
+	//NOTE: { a0+a1, a2+a3, b0+b1, b2+b3 }, haddps is SSE3
+	__m128 even = _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 odd = _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(3, 1, 3, 1));
+	return { _mm_add_ps(even, odd) };
+}
+
+inline lane_s32x4 pairwiseSum(lane_s32x4 a, lane_s32x4 b)
+{
+	//NOTE: phaddd is SSSE3, the same shuffles as for the floats
+	__m128 af = _mm_castsi128_ps(a.v);
+	__m128 bf = _mm_castsi128_ps(b.v);
+	__m128i even = _mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(2, 0, 2, 0)));
+	__m128i odd = _mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(3, 1, 3, 1)));
+	return { _mm_add_epi32(even, odd) };
+}
+
+inline f32 horizontalMin(lane_f32x4 a)
+{
+	f32 lanes[4];
+	_mm_storeu_ps(lanes, a.v);
+	return MIN(MIN(lanes[0], lanes[1]), MIN(lanes[2], lanes[3]));
+}
+
+inline f32 horizontalMax(lane_f32x4 a)
+{
+	f32 lanes[4];
+	_mm_storeu_ps(lanes, a.v);
+	return MAX(MAX(lanes[0], lanes[1]), MAX(lanes[2], lanes[3]));
+}
+
+//AVX2, 8 lanes
+struct lane_f32x8
+{
+	__m256 v;
+};
+
+struct lane_s32x8
+{
+	__m256i v;
+};
+
+inline lane_f32x8 laneF32x8(f32 a)
+{
+	return { _mm256_set1_ps(a) };
+}
+
+inline lane_s32x8 laneS32x8(s32 a)
+{
+	return { _mm256_set1_epi32(a) };
+}
+
+inline lane_f32x8 laneIndexF32x8()
+{
+	return { _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) };
+}
+
+inline lane_f32x8 loadLaneF32x8(f32* a)
+{
+	return { _mm256_load_ps(a) };
+}
+
+inline lane_f32x8 loadUnalignedLaneF32x8(f32* a)
+{
+	return { _mm256_loadu_ps(a) };
+}
+
+inline lane_s32x8 loadLaneS32x8(u32* a)
+{
+	return { _mm256_load_si256((__m256i*)a) };
+}
+
+inline void storeLane(f32* dest, lane_f32x8 a)
+{
+	_mm256_store_ps(dest, a.v);
+}
+
+inline void storeLane(u32* dest, lane_s32x8 a)
+{
+	_mm256_store_si256((__m256i*)dest, a.v);
+}
+
+inline lane_f32x8 operator+(lane_f32x8 a, lane_f32x8 b)
+{
+	return { _mm256_add_ps(a.v, b.v) };
+}
+
+inline lane_f32x8 operator-(lane_f32x8 a, lane_f32x8 b)
+{
+	return { _mm256_sub_ps(a.v, b.v) };
+}
+
+inline lane_f32x8 operator*(lane_f32x8 a, lane_f32x8 b)
+{
+	return { _mm256_mul_ps(a.v, b.v) };
+}
+
+inline lane_f32x8 operator/(lane_f32x8 a, lane_f32x8 b)
+{
+	return { _mm256_div_ps(a.v, b.v) };
+}
+
+inline lane_f32x8 laneMin(lane_f32x8 a, lane_f32x8 b)
+{
+	return { _mm256_min_ps(a.v, b.v) };
+}
+
+inline lane_f32x8 laneMax(lane_f32x8 a, lane_f32x8 b)
+{
+	return { _mm256_max_ps(a.v, b.v) };
+}
+
+inline lane_f32x8 reciprocalSqrt(lane_f32x8 a)
+{
+	return { _mm256_rsqrt_ps(a.v) }; //12 bits of precision, plenty for 8 bit results
+}
+
+inline lane_s32x8 operator+(lane_s32x8 a, lane_s32x8 b)
+{
+	return { _mm256_add_epi32(a.v, b.v) };
+}
+
+inline lane_s32x8 operator-(lane_s32x8 a, lane_s32x8 b)
+{
+	return { _mm256_sub_epi32(a.v, b.v) };
+}
+
+inline lane_s32x8 operator&(lane_s32x8 a, lane_s32x8 b)
+{
+	return { _mm256_and_si256(a.v, b.v) };
+}
+
+inline lane_s32x8 operator|(lane_s32x8 a, lane_s32x8 b)
+{
+	return { _mm256_or_si256(a.v, b.v) };
+}
+
+inline lane_s32x8 operator<<(lane_s32x8 a, s32 shift)
+{
+	return { _mm256_slli_epi32(a.v, shift) };
+}
+
+inline lane_s32x8 operator>>(lane_s32x8 a, s32 shift)
+{
+	return { _mm256_srai_epi32(a.v, shift) };
+}
+
+inline lane_s32x8 laneMin(lane_s32x8 a, lane_s32x8 b)
+{
+	return { _mm256_min_epi32(a.v, b.v) };
+}
+
+inline lane_s32x8 laneMax(lane_s32x8 a, lane_s32x8 b)
+{
+	return { _mm256_max_epi32(a.v, b.v) };
+}
+
+inline lane_f32x8 toF32(lane_s32x8 a)
+{
+	return { _mm256_cvtepi32_ps(a.v) };
+}
+
+inline lane_s32x8 roundToS32(lane_f32x8 a)
+{
+	return { _mm256_cvtps_epi32(a.v) };
+}
+
+inline lane_s32x8 truncateToS32(lane_f32x8 a)
+{
+	return { _mm256_cvttps_epi32(a.v) };
+}
+
+inline lane_s32x8 floorToS32(lane_f32x8 a)
+{
+	return { _mm256_cvtps_epi32(_mm256_round_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)) };
+}
+
+inline lane_f32x8 gatherF32(u8* base, lane_s32x8 byteOffset)
+{
+	return { _mm256_i32gather_ps((f32*)base, byteOffset.v, 1) };
+}
+
+inline lane_s32x8 gatherS32(u8* base, lane_s32x8 byteOffset)
+{
+	return { _mm256_i32gather_epi32((int*)base, byteOffset.v, 1) };
+}
+
+inline lane_f32x8 pairwiseSum(lane_f32x8 a, lane_f32x8 b)
+{
+	//NOTE: the horizontal add works in the 128 bit halves, { a0+a1, a2+a3, b0+b1, b2+b3, a4+a5, ... }, the permute puts the a sums first
+	__m256 sums = _mm256_hadd_ps(a.v, b.v);
+	return { _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sums), _MM_SHUFFLE(3, 1, 2, 0))) };
+}
+
+inline lane_s32x8 pairwiseSum(lane_s32x8 a, lane_s32x8 b)
+{
+	__m256i sums = _mm256_hadd_epi32(a.v, b.v);
+	return { _mm256_permute4x64_epi64(sums, _MM_SHUFFLE(3, 1, 2, 0)) };
+}
+
+inline f32 horizontalMin(lane_f32x8 a)
+{
+	lane_f32x4 halves = { _mm_min_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1)) };
+	return horizontalMin(halves);
+}
+
+inline f32 horizontalMax(lane_f32x8 a)
+{
+	lane_f32x4 halves = { _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1)) };
+	return horizontalMax(halves);
+}
+
+//AVX-512F, 16 lanes
+struct lane_f32x16
+{
+	__m512 v;
+};
+
+struct lane_s32x16
+{
+	__m512i v;
+};
+
+inline lane_f32x16 laneF32x16(f32 a)
+{
+	return { _mm512_set1_ps(a) };
+}
+
+inline lane_s32x16 laneS32x16(s32 a)
+{
+	return { _mm512_set1_epi32(a) };
+}
+
+inline lane_f32x16 laneIndexF32x16()
+{
+	return { _mm512_set_ps(15.f, 14.f, 13.f, 12.f, 11.f, 10.f, 9.f, 8.f, 7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f) };
+}
+
+inline lane_f32x16 loadLaneF32x16(f32* a)
+{
+	return { _mm512_load_ps(a) };
+}
+
+inline lane_f32x16 loadUnalignedLaneF32x16(f32* a)
+{
+	return { _mm512_loadu_ps(a) };
+}
+
+inline lane_s32x16 loadLaneS32x16(u32* a)
+{
+	return { _mm512_load_si512(a) };
+}
+
+inline void storeLane(f32* dest, lane_f32x16 a)
+{
+	_mm512_store_ps(dest, a.v);
+}
+
+inline void storeLane(u32* dest, lane_s32x16 a)
+{
+	_mm512_store_si512(dest, a.v);
+}
+
+inline lane_f32x16 operator+(lane_f32x16 a, lane_f32x16 b)
+{
+	return { _mm512_add_ps(a.v, b.v) };
+}
+
+inline lane_f32x16 operator-(lane_f32x16 a, lane_f32x16 b)
+{
+	return { _mm512_sub_ps(a.v, b.v) };
+}
+
+inline lane_f32x16 operator*(lane_f32x16 a, lane_f32x16 b)
+{
+	return { _mm512_mul_ps(a.v, b.v) };
+}
+
+inline lane_f32x16 operator/(lane_f32x16 a, lane_f32x16 b)
+{
+	return { _mm512_div_ps(a.v, b.v) };
+}
+
+inline lane_f32x16 laneMin(lane_f32x16 a, lane_f32x16 b)
+{
+	return { _mm512_min_ps(a.v, b.v) };
+}
+
+inline lane_f32x16 laneMax(lane_f32x16 a, lane_f32x16 b)
+{
+	return { _mm512_max_ps(a.v, b.v) };
+}
+
+inline lane_f32x16 reciprocalSqrt(lane_f32x16 a)
+{
+	return { _mm512_rsqrt14_ps(a.v) }; //14 bits of precision
+}
+
+inline lane_s32x16 operator+(lane_s32x16 a, lane_s32x16 b)
+{
+	return { _mm512_add_epi32(a.v, b.v) };
+}
+
+inline lane_s32x16 operator-(lane_s32x16 a, lane_s32x16 b)
+{
+	return { _mm512_sub_epi32(a.v, b.v) };
+}
+
+inline lane_s32x16 operator&(lane_s32x16 a, lane_s32x16 b)
+{
+	return { _mm512_and_si512(a.v, b.v) };
+}
+
+inline lane_s32x16 operator|(lane_s32x16 a, lane_s32x16 b)
+{
+	return { _mm512_or_si512(a.v, b.v) };
+}
+
+inline lane_s32x16 operator<<(lane_s32x16 a, s32 shift)
+{
+	return { _mm512_slli_epi32(a.v, shift) };
+}
+
+inline lane_s32x16 operator>>(lane_s32x16 a, s32 shift)
+{
+	return { _mm512_srai_epi32(a.v, shift) };
+}
+
+inline lane_s32x16 laneMin(lane_s32x16 a, lane_s32x16 b)
+{
+	return { _mm512_min_epi32(a.v, b.v) };
+}
+
+inline lane_s32x16 laneMax(lane_s32x16 a, lane_s32x16 b)
+{
+	return { _mm512_max_epi32(a.v, b.v) };
+}
+
+inline lane_f32x16 toF32(lane_s32x16 a)
+{
+	return { _mm512_cvtepi32_ps(a.v) };
+}
+
+inline lane_s32x16 roundToS32(lane_f32x16 a)
+{
+	return { _mm512_cvtps_epi32(a.v) };
+}
+
+inline lane_s32x16 truncateToS32(lane_f32x16 a)
+{
+	return { _mm512_cvttps_epi32(a.v) };
+}
+
+inline lane_s32x16 floorToS32(lane_f32x16 a)
+{
+	return { _mm512_cvt_roundps_epi32(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) };
+}
+
+inline lane_f32x16 gatherF32(u8* base, lane_s32x16 byteOffset)
+{
+	return { _mm512_i32gather_ps(byteOffset.v, base, 1) };
+}
+
+inline lane_s32x16 gatherS32(u8* base, lane_s32x16 byteOffset)
+{
+	return { _mm512_i32gather_epi32(byteOffset.v, base, 1) };
+}
+
+inline lane_f32x16 pairwiseSum(lane_f32x16 a, lane_f32x16 b)
+{
+	//NOTE: no horizontal add for zmm, the even and the odd elements of a:b are picked and added
+	__m512i evenIndex = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+	__m512i oddIndex = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+	return { _mm512_add_ps(_mm512_permutex2var_ps(a.v, evenIndex, b.v), _mm512_permutex2var_ps(a.v, oddIndex, b.v)) };
+}
+
+inline lane_s32x16 pairwiseSum(lane_s32x16 a, lane_s32x16 b)
+{
+	__m512i evenIndex = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+	__m512i oddIndex = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+	return { _mm512_add_epi32(_mm512_permutex2var_epi32(a.v, evenIndex, b.v), _mm512_permutex2var_epi32(a.v, oddIndex, b.v)) };
+}
+
+inline f32 horizontalMin(lane_f32x16 a)
+{
+	lane_f32x8 halves = { _mm256_min_ps(_mm512_castps512_ps256(a.v), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a.v), 1))) };
+	return horizontalMin(halves);
+}
+
+inline f32 horizontalMax(lane_f32x16 a)
+{
+	lane_f32x8 halves = { _mm256_max_ps(_mm512_castps512_ps256(a.v), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a.v), 1))) };
+	return horizontalMax(halves);
+}
@@ -38,6 +38,7 @@ show some debug info (frame time, vertex count, root signature refresh)
 
 #include "math.h"
 #include "memory_arena.h"
+#include "lane.h"
 
 struct DebugTimeInfo
 {
@@ -49,7 +50,7 @@ struct DebugTimeInfo
 struct DebugInfo
 {
 	DebugTimeInfo timeInfos[256];
-	u32 timeInfoCount;
+	u32 volatile timeInfoCount;
 };
 
 struct DebugTimer
@@ -57,8 +58,9 @@ struct DebugTimer
 	DebugTimeInfo* info;
 	DebugTimer(DebugInfo* debugInfo, char* tag)
 	{
-		ASSERT(debugInfo->timeInfoCount < ARRAY_SIZE(debugInfo->timeInfos));
-		info = debugInfo->timeInfos + debugInfo->timeInfoCount++;
+		u32 timeInfoIndex = _InterlockedIncrement((volatile LONG*)&debugInfo->timeInfoCount) - 1; //NOTE: worker threads can time blocks too
+		ASSERT(timeInfoIndex < ARRAY_SIZE(debugInfo->timeInfos));
+		info = debugInfo->timeInfos + timeInfoIndex;
 		info->tag = tag;
 		info->hitCount = 1;
 		info->start = __rdtsc();
@@ -103,25 +105,137 @@ static void updateDebugInfo()
 	g_debugInfo.timeInfoCount = 0;
 }
 
-struct TicketMutex
+//NOTE: MCS lock, every waiter spins on the state of its own node instead of one shared cache line, and
+//falls asleep on the node's event once spinning for longer than the lock usually takes
+enum QUEUED_MUTEX_STATE
 {
-	u64 volatile nextTicket;
-	u64 volatile servingTicket;
+	QUEUED_MUTEX_WAITING,
+	QUEUED_MUTEX_GRANTED,
+	QUEUED_MUTEX_PARKED,
 };
 
-inline void beginTicketMutex(TicketMutex* mutex)
+struct alignas(64) QueuedMutexNode
+{
+	QueuedMutexNode* volatile next;
+	u32 volatile state;
+	HANDLE event; //auto reset, created the first time this node has to park
+};
+
+#define QUEUED_MUTEX_MAX_NESTING 8
+#define QUEUED_MUTEX_MIN_SPIN_COUNT 16
+#define QUEUED_MUTEX_MAX_SPIN_COUNT 1024
+
+//NOTE: a thread holds at most QUEUED_MUTEX_MAX_NESTING locks at once and releases them in reverse order
+thread_local QueuedMutexNode t_queuedMutexNodes[QUEUED_MUTEX_MAX_NESTING];
+thread_local u32 t_queuedMutexNodeCount;
+
+struct QueuedMutex
+{
+	QueuedMutexNode* volatile tail;
+	QueuedMutexNode* owner;
+	u32 spinCount; //adapted to how long the lock is usually waited for
+
+	//NOTE: only written by the owner
+	u64 acquisitionCount;
+	u64 contendedCount;
+	u64 waitCycles;
+};
+
+inline void beginQueuedMutex(QueuedMutex* mutex)
+{
+	ASSERT(t_queuedMutexNodeCount < QUEUED_MUTEX_MAX_NESTING);
+	QueuedMutexNode* node = t_queuedMutexNodes + t_queuedMutexNodeCount++;
+	node->next = 0;
+	node->state = QUEUED_MUTEX_WAITING;
+
+	QueuedMutexNode* prev = (QueuedMutexNode*)_InterlockedExchangePointer((void* volatile*)&mutex->tail, node);
+	u64 waitCycles = 0;
+	u32 spinCount = 0;
+	if (prev)
+	{
+		u64 start = __rdtsc();
+		prev->next = node;
+
+		u32 maxSpinCount = MAX(mutex->spinCount, QUEUED_MUTEX_MIN_SPIN_COUNT);
+		while (node->state == QUEUED_MUTEX_WAITING && spinCount < maxSpinCount)
+		{
+			_mm_pause();
+			++spinCount;
+		}
+		if (node->state == QUEUED_MUTEX_WAITING)
+		{
+			if (!node->event)
+			{
+				node->event = CreateEventA(0, FALSE, FALSE, 0);
+			}
+			if (_InterlockedCompareExchange((volatile LONG*)&node->state, QUEUED_MUTEX_PARKED, QUEUED_MUTEX_WAITING) == QUEUED_MUTEX_WAITING)
+			{
+				WaitForSingleObject(node->event, INFINITE);
+			}
+			spinCount = 0; //spinning was wasted, try shorter next time
+		}
+		ASSERT(node->state == QUEUED_MUTEX_GRANTED);
+		waitCycles = __rdtsc() - start;
+	}
+	_ReadWriteBarrier();
+
+	mutex->owner = node;
+	++mutex->acquisitionCount;
+	if (prev)
+	{
+		++mutex->contendedCount;
+		mutex->waitCycles += waitCycles;
+		//NOTE: moves towards twice the spins a successful wait needed, or halves after parking
+		u32 targetSpinCount = spinCount ? 2 * spinCount : mutex->spinCount / 2;
+		s32 spinCountDelta = (s32)targetSpinCount - (s32)mutex->spinCount;
+		mutex->spinCount = CLAMP(QUEUED_MUTEX_MIN_SPIN_COUNT, QUEUED_MUTEX_MAX_SPIN_COUNT, (s32)mutex->spinCount + spinCountDelta / 4);
+	}
+}
+
+inline void endQueuedMutex(QueuedMutex* mutex)
 {
-	u64 ticket = _InterlockedIncrement64((volatile LONGLONG*)&mutex->nextTicket) - 1;
-	if (ticket != mutex->servingTicket)
+	QueuedMutexNode* node = mutex->owner;
+	ASSERT(t_queuedMutexNodeCount && node == t_queuedMutexNodes + t_queuedMutexNodeCount - 1);
+	mutex->owner = 0;
+	_ReadWriteBarrier();
+
+	if (!node->next)
 	{
-		START_TIMER(WaitingForTicketMutex);
-		busyWaitWhile(ticket != mutex->servingTicket);
-		END_TIMER(WaitingForTicketMutex);
+		if (_InterlockedCompareExchangePointer((void* volatile*)&mutex->tail, 0, node) == node)
+		{
+			--t_queuedMutexNodeCount;
+			return;
+		}
+		busyWaitWhile(!node->next); //the next waiter has swapped the tail but not linked itself yet
 	}
+	QueuedMutexNode* next = node->next;
+	if (_InterlockedExchange((volatile LONG*)&next->state, QUEUED_MUTEX_GRANTED) == QUEUED_MUTEX_PARKED)
+	{
+		SetEvent(next->event);
+	}
+	--t_queuedMutexNodeCount;
+}
+
+//NOTE: the old TicketMutex API, its callers get the queued lock without changes
+typedef QueuedMutex TicketMutex;
+
+inline void beginTicketMutex(TicketMutex* mutex)
+{
+	beginQueuedMutex(mutex);
 }
+
 inline void endTicketMutex(TicketMutex* mutex)
 {
-	_InterlockedIncrement64((volatile LONGLONG*)&mutex->servingTicket);
+	endQueuedMutex(mutex);
+}
+
+static void dumpQueuedMutexStats(QueuedMutex* mutex, char* name)
+{
+	char buff[256];
+	u64 averageWaitCycles = mutex->contendedCount ? mutex->waitCycles / mutex->contendedCount : 0;
+	sprintf_s(buff, "QueuedMutex %s: %llu acquisitions, %llu contended, %llucy waited, %llucy per contended acquisition\n",
+		name, mutex->acquisitionCount, mutex->contendedCount, mutex->waitCycles, averageWaitCycles);
+	OutputDebugStringA(buff);
 }
 
 typedef void(WorkQueueCallback)(void*);
@@ -130,75 +244,432 @@ struct WorkQueueEntry
 {
 	void* data;
 	WorkQueueCallback* callback;
+	u64 pushTime; //rdtsc
 };
 
-struct WorkQueue //NOTE: one producer, multiple consumer
+struct WorkQueueCell
+{
+	u32 volatile sequence; //== index when free, == index + 1 when published
+	WorkQueueEntry entry;
+};
+
+struct alignas(64) WorkQueueRing //NOTE: multiple producer, multiple consumer
 {
 	u32 volatile nextEntryToWrite;
 	u32 volatile nextEntryToRead;
+	WorkQueueCell cells[256];
+};
+
+#define WORK_QUEUE_MAX_THREAD_COUNT 64 //NOTE: the workers are pinned inside the first processor group, which has at most 64 processors
+#define WORK_QUEUE_MAX_NODE_COUNT 8
+
+enum WORK_PRIORITY
+{
+	WORK_PRIORITY_HIGH, //latency critical, always taken before any low priority entry
+	WORK_PRIORITY_LOW, //background refinement
+
+	WORK_PRIORITY_COUNT,
+};
+
+struct WorkQueueOverflowNode
+{
+	WorkQueueOverflowNode* next;
+	WorkQueueEntry entry;
+};
+
+#define WORK_QUEUE_OVERFLOW_BLOCK_NODE_COUNT 1024
+#define WORK_QUEUE_OVERFLOW_NODE_RESERVE_SIZE (4ull * 1024 * 1024 * 1024)
+
+struct WorkQueueOverflow //NOTE: takes the entries when every ring of a priority is full. Producers push lock free, so they never wait for anybody
+{
+	WorkQueueOverflowNode* volatile firstPushed; //newest first
+	u32 volatile consumerLock;
+	WorkQueueOverflowNode* firstToPop; //oldest first, only touched under the consumer lock
+	u32 volatile entryCount;
+};
+
+//NOTE: a node is allocated by the producer and freed by whoever pops it, so the pool has thread caches. It grows by blocks from a
+// concurrent arena and never shrinks
+global ConcurrentMemoryArena g_overflowNodeArena;
+global MemoryPool g_overflowNodePool;
+
+#define WORK_QUEUE_LATENCY_BUCKET_COUNT 24
+#define WORK_QUEUE_LATENCY_FIRST_BUCKET_LOG2 8 //bucket i counts the push to start latencies in [2^(i+8), 2^(i+9)) cycles, the first and last ones everything beyond
+
+struct alignas(64) WorkQueueStats //NOTE: every worker has its own, every other thread that helps shares one, so the counters are added interlocked
+{
+	u64 volatile busyCycles;
+	u64 volatile idleCycles; //only for the workers, waiting on the semaphore and looking for an entry
+	u64 volatile entryCount;
+	u64 volatile stealCount;
+	u64 volatile casRetryCount;
+	u64 volatile overflowCount; //entries pushed while every ring of their priority was full
+	u64 volatile latencyHistogram[WORK_QUEUE_LATENCY_BUCKET_COUNT];
+};
+
+inline void addStat(u64 volatile* stat, u64 value)
+{
+	_InterlockedExchangeAdd64((volatile LONGLONG*)stat, (LONGLONG)value);
+}
+
+#define WORK_QUEUE_DEPTH_SAMPLE_COUNT 1024
+
+struct WorkQueue;
+struct WorkQueueWorker
+{
+	WorkQueue* queue;
+	u32 workerIndex;
+	u32 processorIndex; //pinned to
+	u32 nodeIndex; //in WorkQueue::nodeRings
+	u32 cacheDomainIndex;
+	u8 stealOrder[WORK_QUEUE_MAX_THREAD_COUNT]; //ring indices, own ring first, then the ones sharing the L3, then the node, then the rest
+	WorkQueueStats stats;
+};
+
+struct WorkQueue //NOTE: every worker owns a ring per priority and steals from the others when it runs dry
+{
 	u32 volatile currentlyWorkingThreadCount;
-	WorkQueueEntry entries[256];
+	u32 volatile nextRingToWrite;
+	u32 ringCount; //per priority
+	WorkQueueRing* rings[WORK_PRIORITY_COUNT];
+	WorkQueueOverflow overflows[WORK_PRIORITY_COUNT];
+	WorkQueueWorker workers[WORK_QUEUE_MAX_THREAD_COUNT];
 	HANDLE semaphore;
+
+	u32 nodeCount; //NUMA nodes which have workers
+	u32 nodeRingCounts[WORK_QUEUE_MAX_NODE_COUNT];
+	u8 nodeRings[WORK_QUEUE_MAX_NODE_COUNT][WORK_QUEUE_MAX_THREAD_COUNT];
+	u32 volatile nextNodeRingToWrite[WORK_QUEUE_MAX_NODE_COUNT];
+	u8 helperStealOrder[WORK_QUEUE_MAX_THREAD_COUNT]; //the helpers are not pinned, they just go around
+
+	WorkQueueStats helperStats;
+	u32 depthSamples[WORK_QUEUE_DEPTH_SAMPLE_COUNT][WORK_PRIORITY_COUNT]; //ring buffer, sampled once per frame
+	u32 depthSampleCount;
 };
 
-static void pushEntry(WorkQueue* queue, void* data, WorkQueueCallback* callback)
+global thread_local WorkQueueWorker* t_workQueueWorker;
+
+inline WorkQueueStats* getThreadStats(WorkQueue* queue)
 {
-	u32 nextEntryToWrite = queue->nextEntryToWrite;
-	u32 newNextEntryToWrite = (nextEntryToWrite + 1) % ARRAY_SIZE(queue->entries);
-	
-	if (newNextEntryToWrite == queue->nextEntryToRead)
+	WorkQueueWorker* worker = t_workQueueWorker;
+	return (worker && worker->queue == queue) ? &worker->stats : &queue->helperStats;
+}
+
+#define SCRATCH_ARENA_SIZE (1024 * 1024 * 1024) //reserved, committed as it is used
+
+//NOTE: every thread running entries owns one, an entry gets it empty and everything it pushes is popped after it returns
+global thread_local MemoryArena t_scratchArena;
+
+static MemoryArena* getScratchArena()
+{
+	if (!t_scratchArena.base)
 	{
-		TIMED_BLOCK();
-		busyWaitWhile(newNextEntryToWrite == queue->nextEntryToRead);
+		t_scratchArena = createGrowableMemoryArena(SCRATCH_ARENA_SIZE);
 	}
+	return &t_scratchArena;
+}
 
-	WorkQueueEntry* entry = queue->entries + queue->nextEntryToWrite;
-	entry->callback = callback;
-	entry->data = data;
-	
-	_WriteBarrier();
-	queue->nextEntryToWrite = newNextEntryToWrite;
+global thread_local u32 t_runEntryDepth;
+
+static void runEntry(WorkQueueEntry* entry, WorkQueueStats* stats)
+{
+	u64 startTime = __rdtsc();
+	u64 latency = startTime - entry->pushTime;
+	unsigned long latencyLog2 = 0;
+	_BitScanReverse64(&latencyLog2, latency | 1);
+	u32 bucketIndex = CLAMP(0, WORK_QUEUE_LATENCY_BUCKET_COUNT - 1, (s32)latencyLog2 - WORK_QUEUE_LATENCY_FIRST_BUCKET_LOG2);
+	addStat(&stats->latencyHistogram[bucketIndex], 1);
+	addStat(&stats->entryCount, 1);
 
-	ReleaseSemaphore(queue->semaphore, 1, 0);
+	//NOTE: a temp memory instead of a reset, an entry can help running other entries while it waits
+	TempMemory scratch = startTempMemory(getScratchArena());
+	++t_runEntryDepth;
+	entry->callback(entry->data);
+	--t_runEntryDepth;
+	endTempMemory(&scratch);
+
+	if (t_runEntryDepth == 0) //the entries run while helping are already in the time of the outer one
+	{
+		addStat(&stats->busyCycles, __rdtsc() - startTime);
+	}
 }
 
-static WorkQueueEntry popEntry(WorkQueue* queue)
+static b32 pushEntry(WorkQueueRing* ring, WorkQueueEntry* entry, WorkQueueStats* stats)
 {
-	WorkQueueEntry result = {};
-	bool success = false;
-	while (!success)
+	while (1)
 	{
-		u32 nextEntryToRead = queue->nextEntryToRead;
-		u32 newNextEntryToRead = (nextEntryToRead + 1) % ARRAY_SIZE(queue->entries);
-		if (nextEntryToRead != queue->nextEntryToWrite)
+		u32 nextEntryToWrite = ring->nextEntryToWrite;
+		WorkQueueCell* cell = ring->cells + (nextEntryToWrite % ARRAY_SIZE(ring->cells));
+		s32 diff = (s32)(cell->sequence - nextEntryToWrite);
+		if (diff < 0) //ring is full
+		{
+			return false;
+		}
+		if (diff == 0)
 		{
-			result = queue->entries[nextEntryToRead];
+			u32 nextEntryToWrite2 = _InterlockedCompareExchange(
+				(volatile LONG*)&ring->nextEntryToWrite,
+				(LONG)(nextEntryToWrite + 1),
+				nextEntryToWrite
+			);
+
+			if (nextEntryToWrite == nextEntryToWrite2)
+			{
+				cell->entry = *entry;
+
+				_WriteBarrier();
+				cell->sequence = nextEntryToWrite + 1;
+				return true;
+			}
+		}
+		//else another producer has taken this cell, try the next one
+		addStat(&stats->casRetryCount, 1);
+	}
+}
+
+static b32 popEntry(WorkQueueRing* ring, WorkQueueEntry* result, WorkQueueStats* stats)
+{
+	while (1)
+	{
+		u32 nextEntryToRead = ring->nextEntryToRead;
+		WorkQueueCell* cell = ring->cells + (nextEntryToRead % ARRAY_SIZE(ring->cells));
+		s32 diff = (s32)(cell->sequence - (nextEntryToRead + 1));
+		if (diff < 0) //ring is empty, or the producer hasn't published the entry yet
+		{
+			return false;
+		}
+		if (diff == 0)
+		{
+			*result = cell->entry;
 			u32 nextEntryToRead2 = _InterlockedCompareExchange(
-				(volatile LONG*)&queue->nextEntryToRead,
-				(LONG)newNextEntryToRead,
+				(volatile LONG*)&ring->nextEntryToRead,
+				(LONG)(nextEntryToRead + 1),
 				nextEntryToRead
 			);
 
 			if (nextEntryToRead == nextEntryToRead2)
 			{
-				success = true;
+				cell->sequence = nextEntryToRead + ARRAY_SIZE(ring->cells);
+				return true;
+			}
+		}
+		//else another consumer has taken this cell, try the next one
+		addStat(&stats->casRetryCount, 1);
+	}
+}
+
+inline void pushOverflowNodes(WorkQueueOverflowNode* volatile* stack, WorkQueueOverflowNode* first, WorkQueueOverflowNode* last)
+{
+	//NOTE: the consumers only ever take the whole stack at once, so there is no ABA problem
+	WorkQueueOverflowNode* oldFirst;
+	do
+	{
+		oldFirst = *stack;
+		last->next = oldFirst;
+	} while (_InterlockedCompareExchangePointer((void* volatile*)stack, first, oldFirst) != oldFirst);
+}
+
+static void pushEntry(WorkQueueOverflow* overflow, WorkQueueEntry* entry)
+{
+	WorkQueueOverflowNode* node = allocateFromPool(&g_overflowNodePool, WorkQueueOverflowNode);
+	ASSERT(node);
+	node->entry = *entry;
+	_InterlockedIncrement((volatile LONG*)&overflow->entryCount);
+	pushOverflowNodes(&overflow->firstPushed, node, node);
+}
+
+static b32 popEntry(WorkQueueOverflow* overflow, WorkQueueEntry* result)
+{
+	if (overflow->entryCount == 0)
+	{
+		return false;
+	}
+
+	//NOTE: a try lock, if another consumer is in there we look somewhere else instead of waiting
+	if (_InterlockedCompareExchange((volatile LONG*)&overflow->consumerLock, 1, 0) != 0)
+	{
+		return false;
+	}
+
+	if (!overflow->firstToPop)
+	{
+		//NOTE: every node is reversed only once, so the popping stays O(1) amortized
+		WorkQueueOverflowNode* node = (WorkQueueOverflowNode*)_InterlockedExchangePointer((void* volatile*)&overflow->firstPushed, 0);
+		while (node)
+		{
+			WorkQueueOverflowNode* next = node->next;
+			node->next = overflow->firstToPop;
+			overflow->firstToPop = node;
+			node = next;
+		}
+	}
+
+	b32 popped = false;
+	WorkQueueOverflowNode* node = overflow->firstToPop;
+	if (node)
+	{
+		overflow->firstToPop = node->next;
+		*result = node->entry;
+		freeToPool(&g_overflowNodePool, node);
+		_InterlockedDecrement((volatile LONG*)&overflow->entryCount);
+		popped = true;
+	}
+
+	_InterlockedExchange((volatile LONG*)&overflow->consumerLock, 0);
+	return popped;
+}
+
+static WorkQueueEntry popEntry(WorkQueue* queue, u8* stealOrder, WorkQueueStats* stats)
+{
+	//NOTE: higher priorities first, in each priority own ring first, then steal from the nearest neighbours, then the overflow
+	WorkQueueEntry result = {};
+	for (u32 priority = 0; priority < WORK_PRIORITY_COUNT; ++priority)
+	{
+		WorkQueueRing* rings = queue->rings[priority];
+		for (u32 tryIndex = 0; tryIndex < queue->ringCount; ++tryIndex)
+		{
+			if (popEntry(rings + stealOrder[tryIndex], &result, stats))
+			{
+				if (tryIndex > 0)
+				{
+					addStat(&stats->stealCount, 1);
+				}
+				return result;
 			}
 		}
-		else //queue is empty
+		if (popEntry(queue->overflows + priority, &result))
 		{
-			result = {};
-			success = true;
+			return result;
 		}
 	}
 
 	return result;
 }
 
+inline u8* getStealOrder(WorkQueue* queue)
+{
+	WorkQueueWorker* worker = t_workQueueWorker;
+	return (worker && worker->queue == queue) ? worker->stealOrder : queue->helperStealOrder;
+}
+
+static b32 tryRunNextEntry(WorkQueue* queue)
+{
+	b32 result = false;
+	if (WaitForSingleObject(queue->semaphore, 0) == WAIT_OBJECT_0)
+	{
+		//NOTE: the semaphore guarantees that there is an entry for us somewhere, but a thief can take the one we are looking at, so we go around again
+		WorkQueueStats* stats = getThreadStats(queue);
+		WorkQueueEntry entry = {};
+		while (!entry.callback)
+		{
+			entry = popEntry(queue, getStealOrder(queue), stats);
+		}
+		runEntry(&entry, stats);
+		result = true;
+	}
+	return result;
+}
+
+//NOTE: like busyWaitWhile, but the waiting thread runs jobs of the queue in the meantime, so a stall on the queue shortens itself
+#define helpingWaitWhile(queue, expr) while(expr) { if (!tryRunNextEntry(queue)) { _mm_pause(); } }
+
+static void pushEntries(WorkQueue* queue, void* firstData, u32 entryCount, u32 dataStride, WorkQueueCallback* callback, WORK_PRIORITY priority = WORK_PRIORITY_HIGH)
+{
+	//NOTE: a worker pushes to its own ring, everybody else deals the entries round robin,
+	// so every worker finds its share in its own ring and the rings are only contended by thieves.
+	// With more than one NUMA node the entries of a batch are dealt in contiguous blocks to the nodes instead. The parts of a batch
+	// are usually neighbouring pieces of one image, and the same batch always lands on the same nodes, so a node keeps seeing the same
+	// part of an image. Where the pages of the image live is up to the OS, nothing here allocates per node
+	ASSERT(entryCount > 0);
+	WorkQueueWorker* worker = t_workQueueWorker;
+	b32 isOwnQueue = worker && worker->queue == queue;
+	b32 spreadOverNodes = queue->nodeCount > 1 && entryCount > 1;
+	u32 firstRingIndex = isOwnQueue ? 
+		worker->workerIndex : 
+		(u32)_InterlockedExchangeAdd((volatile LONG*)&queue->nextRingToWrite, entryCount);
+	WorkQueueRing* rings = queue->rings[priority];
+	WorkQueueStats* stats = getThreadStats(queue);
+
+	u32 nodeIndex = U32_MAX;
+	u32 firstNodeRingIndex = 0;
+
+	u32 overflowCount = 0;
+	WorkQueueEntry entry = {};
+	entry.callback = callback;
+	entry.pushTime = __rdtsc();
+	for (u32 entryIndex = 0; entryIndex < entryCount; ++entryIndex)
+	{
+		entry.data = (u8*)firstData + entryIndex * dataStride;
+		u32 ringIndex = isOwnQueue ? firstRingIndex : firstRingIndex + entryIndex;
+		if (spreadOverNodes)
+		{
+			u32 entryNodeIndex = (u32)((u64)entryIndex * queue->nodeCount / entryCount);
+			if (entryNodeIndex != nodeIndex)
+			{
+				nodeIndex = entryNodeIndex;
+				firstNodeRingIndex = (u32)_InterlockedExchangeAdd((volatile LONG*)&queue->nextNodeRingToWrite[nodeIndex], entryCount) - entryIndex;
+			}
+			ringIndex = (isOwnQueue && worker->nodeIndex == nodeIndex) ?
+				worker->workerIndex :
+				queue->nodeRings[nodeIndex][(firstNodeRingIndex + entryIndex) % queue->nodeRingCounts[nodeIndex]];
+		}
+
+		b32 pushed = false;
+		for (u32 tryIndex = 0; tryIndex < queue->ringCount && !pushed; ++tryIndex)
+		{
+			pushed = pushEntry(rings + (ringIndex + tryIndex) % queue->ringCount, &entry, stats);
+		}
+
+		if (!pushed)
+		{
+			pushEntry(queue->overflows + priority, &entry);
+			++overflowCount;
+		}
+	}
+	if (overflowCount)
+	{
+		addStat(&stats->overflowCount, overflowCount);
+	}
+
+	//NOTE: one wake up for the whole batch
+	ReleaseSemaphore(queue->semaphore, entryCount, 0);
+}
+
+inline void pushEntry(WorkQueue* queue, void* data, WorkQueueCallback* callback, WORK_PRIORITY priority = WORK_PRIORITY_HIGH)
+{
+	pushEntries(queue, data, 1, 0, callback, priority);
+}
+
+static b32 queueIsEmpty(WorkQueue* queue)
+{
+	for (u32 priority = 0; priority < WORK_PRIORITY_COUNT; ++priority)
+	{
+		for (u32 ringIndex = 0; ringIndex < queue->ringCount; ++ringIndex)
+		{
+			WorkQueueRing* ring = queue->rings[priority] + ringIndex;
+			if (ring->nextEntryToRead != ring->nextEntryToWrite)
+			{
+				return false;
+			}
+		}
+		if (queue->overflows[priority].entryCount != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 static DWORD threadProc(LPVOID lpParam)
 {
-	WorkQueue* queue = (WorkQueue*)lpParam;
+	WorkQueueWorker* worker = (WorkQueueWorker*)lpParam;
+	WorkQueue* queue = worker->queue;
+	t_workQueueWorker = worker;
+	WorkQueueStats* stats = &worker->stats;
+	getScratchArena();
 	srand((u32)(umm)&queue);
 
+	u64 idleStartTime = __rdtsc();
 	while (1)
 	{
 		DWORD waitResult = WaitForSingleObject(queue->semaphore, 0);
@@ -211,45 +682,517 @@ static DWORD threadProc(LPVOID lpParam)
 		}
 		ASSERT(waitResult == WAIT_OBJECT_0);
 
-		WorkQueueEntry entry = popEntry(queue);
-		ASSERT(entry.callback); //otherwise the queue was empty, but that shouldn't happen, since we waited for the semaphore
-		entry.callback(entry.data);
+		//NOTE: the semaphore guarantees that there is an entry for us somewhere, but a thief can take the one we are looking at, so we go around again
+		WorkQueueEntry entry = {};
+		while (!entry.callback)
+		{
+			entry = popEntry(queue, worker->stealOrder, stats);
+		}
+
+		u64 busyStartTime = __rdtsc();
+		addStat(&stats->idleCycles, busyStartTime - idleStartTime);
+		runEntry(&entry, stats);
+		idleStartTime = __rdtsc();
 	}
 	return 0;
 }
 
 static void flushQueue(WorkQueue* queue)
 {
-	while (queue->nextEntryToRead != queue->nextEntryToWrite)
+	//NOTE: a running job can still push new entries, so we keep helping until the workers went to sleep too
+	helpingWaitWhile(queue, !queueIsEmpty(queue) || queue->currentlyWorkingThreadCount != 0);
+}
+
+static void sampleWorkQueueDepth(WorkQueue* queue)
+{
+	u32* sample = queue->depthSamples[queue->depthSampleCount++ % WORK_QUEUE_DEPTH_SAMPLE_COUNT];
+	for (u32 priority = 0; priority < WORK_PRIORITY_COUNT; ++priority)
 	{
-		DWORD waitResult = WaitForSingleObject(queue->semaphore, 0);
-		if (waitResult == WAIT_OBJECT_0)
+		u32 depth = queue->overflows[priority].entryCount;
+		for (u32 ringIndex = 0; ringIndex < queue->ringCount; ++ringIndex)
 		{
-			WorkQueueEntry entry = popEntry(queue);
-			ASSERT(entry.callback);
-			entry.callback(entry.data);
+			WorkQueueRing* ring = queue->rings[priority] + ringIndex;
+			depth += ring->nextEntryToWrite - ring->nextEntryToRead;
+		}
+		sample[priority] = depth;
+	}
+}
+
+static void dumpWorkQueueStats(WorkQueue* queue)
+{
+	char buff[256];
+	OutputDebugStringA("WorkQueue stats\n  thread     busy     idle    entries     steals cas retries  overflows  cpu node\n");
+
+	u64 latencyHistogram[WORK_QUEUE_LATENCY_BUCKET_COUNT] = {};
+	for (u32 statsIndex = 0; statsIndex <= queue->ringCount; ++statsIndex)
+	{
+		b32 isHelper = statsIndex == queue->ringCount;
+		WorkQueueStats* stats = isHelper ? &queue->helperStats : &queue->workers[statsIndex].stats;
+
+		char name[16];
+		if (isHelper)
+		{
+			sprintf_s(name, "helpers");
 		}
 		else
 		{
-			ASSERT(waitResult == WAIT_TIMEOUT);
+			sprintf_s(name, "worker%u", statsIndex);
+		}
+
+		u64 totalCycles = MAX(1, stats->busyCycles + stats->idleCycles);
+		sprintf_s(buff, "  %-8s %7.1f%% %7.1f%% %10llu %10llu %11llu %10llu %4d %4d\n", name,
+			isHelper ? 0.f : 100.f * (f32)stats->busyCycles / (f32)totalCycles, isHelper ? 0.f : 100.f * (f32)stats->idleCycles / (f32)totalCycles,
+			stats->entryCount, stats->stealCount, stats->casRetryCount, stats->overflowCount,
+			isHelper ? -1 : (s32)queue->workers[statsIndex].processorIndex, isHelper ? -1 : (s32)queue->workers[statsIndex].nodeIndex);
+		OutputDebugStringA(buff);
+
+		for (u32 bucketIndex = 0; bucketIndex < WORK_QUEUE_LATENCY_BUCKET_COUNT; ++bucketIndex)
+		{
+			latencyHistogram[bucketIndex] += stats->latencyHistogram[bucketIndex];
+		}
+	}
+
+	OutputDebugStringA("Push to start latency\n");
+	for (u32 bucketIndex = 0; bucketIndex < WORK_QUEUE_LATENCY_BUCKET_COUNT; ++bucketIndex)
+	{
+		if (latencyHistogram[bucketIndex])
+		{
+			sprintf_s(buff, "  < 2^%-2u cy %10llu\n", bucketIndex + WORK_QUEUE_LATENCY_FIRST_BUCKET_LOG2 + 1, latencyHistogram[bucketIndex]);
+			OutputDebugStringA(buff);
+		}
+	}
+
+	u32 sampleCount = MIN(queue->depthSampleCount, WORK_QUEUE_DEPTH_SAMPLE_COUNT);
+	sprintf_s(buff, "Queue depth over the last %u frames\n", sampleCount);
+	OutputDebugStringA(buff);
+	for (u32 priority = 0; priority < WORK_PRIORITY_COUNT; ++priority)
+	{
+		u32 minDepth = 0xffffffff;
+		u32 maxDepth = 0;
+		u64 depthSum = 0;
+		for (u32 sampleIndex = 0; sampleIndex < sampleCount; ++sampleIndex)
+		{
+			u32 depth = queue->depthSamples[sampleIndex][priority];
+			minDepth = MIN(minDepth, depth);
+			maxDepth = MAX(maxDepth, depth);
+			depthSum += depth;
+		}
+		sprintf_s(buff, "  priority %u: min %u, avg %.1f, max %u\n", priority, sampleCount ? minDepth : 0, (f32)depthSum / (f32)MAX(1, sampleCount), maxDepth);
+		OutputDebugStringA(buff);
+	}
+}
+
+static u32 getLogicalProcessorCount()
+{
+	SYSTEM_INFO systemInfo = {};
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwNumberOfProcessors;
+}
+
+//NOTE: queried once by initWorkQueue, the image tiling reads them for every task
+global u32 g_l2CacheSize;
+global u32 g_logicalProcessorCount;
+
+static u32 getL2CacheSize()
+{
+	u32 result = 256 * 1024; //if the query fails
+
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION infos[256];
+	DWORD size = sizeof(infos);
+	if (GetLogicalProcessorInformation(infos, &size))
+	{
+		for (u32 infoIndex = 0; infoIndex < size / sizeof(*infos); ++infoIndex)
+		{
+			SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info = infos + infoIndex;
+			if (info->Relationship == RelationCache && info->Cache.Level == 2)
+			{
+				result = info->Cache.Size;
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+struct CpuTopology //NOTE: of the first processor group, a processor is the bit index in its affinity mask
+{
+	u32 processorCount;
+	u32 coreCount;
+	u32 cacheDomainCount; //processors sharing an L3
+	u32 nodeCount;
+	u8 processorCores[WORK_QUEUE_MAX_THREAD_COUNT];
+	u8 processorCacheDomains[WORK_QUEUE_MAX_THREAD_COUNT];
+	u8 processorNodes[WORK_QUEUE_MAX_THREAD_COUNT];
+};
+
+static CpuTopology getCpuTopology()
+{
+	//NOTE: if the query fails every processor is its own core and they all share one L3 on one node
+	CpuTopology result = {};
+	result.processorCount = MIN(getLogicalProcessorCount(), WORK_QUEUE_MAX_THREAD_COUNT);
+	for (u32 processorIndex = 0; processorIndex < result.processorCount; ++processorIndex)
+	{
+		result.processorCores[processorIndex] = (u8)processorIndex;
+	}
+	result.coreCount = result.processorCount;
+	result.cacheDomainCount = 1;
+	result.nodeCount = 1;
+
+	alignas(8) u8 buffer[32 * 1024];
+	DWORD size = sizeof(buffer);
+	if (GetLogicalProcessorInformationEx(RelationAll, (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)buffer, &size))
+	{
+		u32 coreCount = 0;
+		u32 cacheDomainCount = 0;
+		u32 nodeCount = 0;
+		for (u8* at = buffer; at < buffer + size; at += ((SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)at)->Size)
+		{
+			SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)at;
+			GROUP_AFFINITY* groupMask = 0;
+			u8* processorIndices = 0;
+			u32* count = 0;
+			if (info->Relationship == RelationProcessorCore)
+			{
+				groupMask = info->Processor.GroupMask;
+				processorIndices = result.processorCores;
+				count = &coreCount;
+			}
+			else if (info->Relationship == RelationCache && info->Cache.Level == 3)
+			{
+				groupMask = &info->Cache.GroupMask;
+				processorIndices = result.processorCacheDomains;
+				count = &cacheDomainCount;
+			}
+			else if (info->Relationship == RelationNumaNode)
+			{
+				groupMask = &info->NumaNode.GroupMask;
+				processorIndices = result.processorNodes;
+				count = &nodeCount;
+			}
+
+			if (groupMask && groupMask->Group == 0)
+			{
+				for (u32 processorIndex = 0; processorIndex < result.processorCount; ++processorIndex)
+				{
+					if (groupMask->Mask & (1ull << processorIndex))
+					{
+						processorIndices[processorIndex] = (u8)*count;
+					}
+				}
+				++*count;
+			}
+		}
+
+		result.coreCount = coreCount ? coreCount : result.coreCount;
+		result.cacheDomainCount = cacheDomainCount ? cacheDomainCount : result.cacheDomainCount;
+		result.nodeCount = nodeCount ? nodeCount : result.nodeCount;
+	}
+
+	return result;
+}
+
+static void getWorkerProcessors(CpuTopology* topology, u8* processorOrder)
+{
+	//NOTE: the first processor of every core comes before the SMT siblings, and inside of that the nodes take turns,
+	// so a pool smaller than the machine still gets a whole core per worker and the memory bandwidth of every socket
+	u32 smtRanks[WORK_QUEUE_MAX_THREAD_COUNT];
+	b32 taken[WORK_QUEUE_MAX_THREAD_COUNT] = {};
+	for (u32 processorIndex = 0; processorIndex < topology->processorCount; ++processorIndex)
+	{
+		smtRanks[processorIndex] = 0;
+		for (u32 prevIndex = 0; prevIndex < processorIndex; ++prevIndex)
+		{
+			smtRanks[processorIndex] += topology->processorCores[prevIndex] == topology->processorCores[processorIndex];
+		}
+	}
+
+	u32 orderCount = 0;
+	for (u32 smtRank = 0; orderCount < topology->processorCount; ++smtRank)
+	{
+		b32 found = true;
+		while (found)
+		{
+			found = false;
+			for (u32 nodeIndex = 0; nodeIndex < topology->nodeCount; ++nodeIndex)
+			{
+				for (u32 processorIndex = 0; processorIndex < topology->processorCount; ++processorIndex)
+				{
+					if (!taken[processorIndex] && smtRanks[processorIndex] == smtRank && topology->processorNodes[processorIndex] == nodeIndex)
+					{
+						taken[processorIndex] = true;
+						processorOrder[orderCount++] = (u8)processorIndex;
+						found = true;
+						break;
+					}
+				}
+			}
 		}
 	}
-	while (queue->currentlyWorkingThreadCount != 0);
 }
 
 static void initWorkQueue(WorkQueue* queue, u32 threadCount)
 {
-	queue->nextEntryToRead = 0;
-	queue->nextEntryToWrite = 0;
+	ASSERT(threadCount > 0 && threadCount <= WORK_QUEUE_MAX_THREAD_COUNT);
+
 	queue->currentlyWorkingThreadCount = threadCount;
+	queue->nextRingToWrite = 0;
+	queue->ringCount = threadCount;
+
+	WorkQueueRing* rings = (WorkQueueRing*)VirtualAlloc(0, WORK_PRIORITY_COUNT * threadCount * sizeof(WorkQueueRing), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	ASSERT(rings);
+	for (u32 ringIndex = 0; ringIndex < WORK_PRIORITY_COUNT * threadCount; ++ringIndex)
+	{
+		WorkQueueRing* ring = rings + ringIndex;
+		for (u32 cellIndex = 0; cellIndex < ARRAY_SIZE(ring->cells); ++cellIndex)
+		{
+			ring->cells[cellIndex].sequence = cellIndex;
+		}
+	}
+	for (u32 priority = 0; priority < WORK_PRIORITY_COUNT; ++priority)
+	{
+		queue->rings[priority] = rings + priority * threadCount;
+	}
+
+	for (u32 priority = 0; priority < WORK_PRIORITY_COUNT; ++priority)
+	{
+		queue->overflows[priority] = {};
+	}
+	queue->helperStats = {};
+	queue->depthSampleCount = 0;
 
-	queue->semaphore = CreateSemaphoreA(0, 0, ARRAY_SIZE(queue->entries), 0);
+	queue->semaphore = CreateSemaphoreA(0, 0, MAXLONG, 0); //the overflow is unbounded
+	if (!g_overflowNodeArena.base)
+	{
+		//NOTE: shared by all queues, nothing spills before the first one exists
+		g_overflowNodeArena = createGrowableConcurrentMemoryArena(WORK_QUEUE_OVERFLOW_NODE_RESERVE_SIZE);
+		g_overflowNodePool = createMemoryPool(&g_overflowNodeArena, WorkQueueOverflowNode, WORK_QUEUE_OVERFLOW_BLOCK_NODE_COUNT);
+	}
+
+	CpuTopology topology = getCpuTopology();
+	g_l2CacheSize = getL2CacheSize();
+	g_logicalProcessorCount = getLogicalProcessorCount();
+	u8 processorOrder[WORK_QUEUE_MAX_THREAD_COUNT];
+	getWorkerProcessors(&topology, processorOrder);
+
+	u8 nodeIndices[WORK_QUEUE_MAX_NODE_COUNT]; //topology node -> queue node
+	memset(nodeIndices, 0xff, sizeof(nodeIndices));
+	queue->nodeCount = 0;
+	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		WorkQueueWorker* worker = queue->workers + threadIndex;
+		worker->queue = queue;
+		worker->workerIndex = threadIndex;
+		worker->processorIndex = processorOrder[threadIndex % topology.processorCount];
+		worker->cacheDomainIndex = topology.processorCacheDomains[worker->processorIndex];
+		worker->stats = {};
+
+		u32 topologyNodeIndex = MIN(topology.processorNodes[worker->processorIndex], WORK_QUEUE_MAX_NODE_COUNT - 1);
+		if (nodeIndices[topologyNodeIndex] == 0xff)
+		{
+			nodeIndices[topologyNodeIndex] = (u8)queue->nodeCount;
+			queue->nodeRingCounts[queue->nodeCount] = 0;
+			queue->nextNodeRingToWrite[queue->nodeCount] = 0;
+			++queue->nodeCount;
+		}
+		worker->nodeIndex = nodeIndices[topologyNodeIndex];
+		queue->nodeRings[worker->nodeIndex][queue->nodeRingCounts[worker->nodeIndex]++] = (u8)threadIndex;
+	}
+
+	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		//NOTE: starting after the own ring, so the workers of one domain don't all rob the same neighbour first
+		WorkQueueWorker* worker = queue->workers + threadIndex;
+		u32 orderCount = 0;
+		for (u32 distance = 0; distance < 4; ++distance)
+		{
+			for (u32 tryIndex = 0; tryIndex < threadCount; ++tryIndex)
+			{
+				WorkQueueWorker* other = queue->workers + (threadIndex + tryIndex) % threadCount;
+				u32 otherDistance = other == worker ? 0 :
+					other->cacheDomainIndex == worker->cacheDomainIndex ? 1 :
+					other->nodeIndex == worker->nodeIndex ? 2 : 3;
+				if (otherDistance == distance)
+				{
+					worker->stealOrder[orderCount++] = (u8)other->workerIndex;
+				}
+			}
+		}
+		ASSERT(orderCount == threadCount);
+		queue->helperStealOrder[threadIndex] = (u8)threadIndex;
+	}
+
+	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		WorkQueueWorker* worker = queue->workers + threadIndex;
+		DWORD threadID;
+		HANDLE threadHandle = CreateThread(0, 0, threadProc, worker, CREATE_SUSPENDED, &threadID);
+		if (!SetThreadAffinityMask(threadHandle, 1ull << worker->processorIndex)) //NOTE: before it runs, so it never starts anywhere else
+		{
+			char buff[256];
+			sprintf_s(buff, "Worker %u could not be pinned to processor %u (error %u), it runs unpinned\n", threadIndex, worker->processorIndex, GetLastError());
+			OutputDebugStringA(buff);
+		}
+		ResumeThread(threadHandle);
+		CloseHandle(threadHandle);
+	}
+}
+
+struct TaskGraph;
+struct Task;
+
+struct TaskPart
+{
+	Task* task;
+	void* data;
+};
+
+#define TASK_MAX_DEPENDENT_COUNT 4
+
+struct Task
+{
+	TaskGraph* graph;
+	WorkQueueCallback* callback;
+	TaskPart* parts;
+	u32 partCount;
+
+	Task* dependents[TASK_MAX_DEPENDENT_COUNT];
+	u32 dependentCount;
+	u32 dependencyCount;
+
+	u32 volatile unfinishedPartCount;
+	u32 volatile unfinishedDependencyCount;
+};
+
+struct TaskGraph //NOTE: a task is pushed by the last finishing part of its last dependency, so the stages chain without a round trip to the submitting thread
+{
+	WorkQueue* queue;
+	WORK_PRIORITY volatile priority; //of the tasks that are not pushed yet
+	Task tasks[16];
+	u32 taskCount;
+	u32 volatile unfinishedTaskCount;
+
+	b32 volatile cancelled; //the parts still run, but the long ones check it and give up early
+};
+
+global thread_local Task* t_runningTask;
+
+static Task* addTask(MemoryArena* arena, TaskGraph* graph, WorkQueueCallback* callback, void* partData, u32 partCount = 1, u32 partStride = 0)
+{
+	ASSERT(graph->taskCount < ARRAY_SIZE(graph->tasks));
+	ASSERT(partCount > 0);
+
+	Task* result = graph->tasks + graph->taskCount++;
+	*result = {};
+	result->graph = graph;
+	result->callback = callback;
+	result->partCount = partCount;
+	result->parts = pushArray(arena, partCount, TaskPart);
+	ASSERT(result->parts);
+
+	for (u32 partIndex = 0; partIndex < partCount; ++partIndex)
+	{
+		result->parts[partIndex].task = result;
+		result->parts[partIndex].data = (u8*)partData + partIndex * partStride;
+	}
+
+	return result;
+}
+
+static void addDependency(Task* task, Task* dependency)
+{
+	ASSERT(task->graph == dependency->graph);
+	ASSERT(dependency->dependentCount < ARRAY_SIZE(dependency->dependents));
+	dependency->dependents[dependency->dependentCount++] = task;
+	++task->dependencyCount;
+}
+
+static void _runTaskPart(void* data);
+
+static void _pushTask(Task* task)
+{
+	pushEntries(task->graph->queue, task->parts, task->partCount, sizeof(TaskPart), _runTaskPart, task->graph->priority);
+}
+
+static void _runTaskPart(void* data)
+{
+	TaskPart* part = (TaskPart*)data;
+	Task* task = part->task;
+	TaskGraph* graph = task->graph;
+
+	//NOTE: a part can help running other parts while it waits, so the running task is restored afterwards
+	Task* prevRunningTask = t_runningTask;
+	t_runningTask = task;
+	task->callback(part->data);
+	t_runningTask = prevRunningTask;
+
+	if (_InterlockedDecrement((volatile LONG*)&task->unfinishedPartCount) == 0)
+	{
+		for (u32 dependentIndex = 0; dependentIndex < task->dependentCount; ++dependentIndex)
+		{
+			Task* dependent = task->dependents[dependentIndex];
+			if (_InterlockedDecrement((volatile LONG*)&dependent->unfinishedDependencyCount) == 0)
+			{
+				_pushTask(dependent);
+			}
+		}
+		//NOTE: the dependents are already counted, the graph can't look finished before they are done
+		_InterlockedDecrement((volatile LONG*)&graph->unfinishedTaskCount);
+	}
+}
+
+inline b32 taskGraphFinished(TaskGraph* graph)
+{
+	return graph->unfinishedTaskCount == 0;
+}
+
+inline void raiseTaskGraphPriority(TaskGraph* graph, WORK_PRIORITY priority)
+{
+	//NOTE: the entries already in the queue keep their priority, only the later stages are pushed with the new one
+	if (priority < graph->priority)
+	{
+		graph->priority = priority;
+	}
+}
+
+static void waitForTaskGraph(TaskGraph* graph)
+{
+	helpingWaitWhile(graph->queue, !taskGraphFinished(graph));
+}
+
+inline b32 runningTaskCancelled()
+{
+	return t_runningTask && t_runningTask->graph->cancelled;
+}
+
+inline void cancelTaskGraph(TaskGraph* graph)
+{
+	graph->cancelled = true;
+}
+
+static void submitTaskGraph(WorkQueue* queue, TaskGraph* graph, WORK_PRIORITY priority)
+{
+	ASSERT(taskGraphFinished(graph));
+
+	graph->queue = queue;
+	graph->priority = priority;
+	graph->cancelled = false;
+	graph->unfinishedTaskCount = graph->taskCount;
+	for (u32 taskIndex = 0; taskIndex < graph->taskCount; ++taskIndex)
+	{
+		Task* task = graph->tasks + taskIndex;
+		task->unfinishedPartCount = task->partCount;
+		task->unfinishedDependencyCount = task->dependencyCount;
+	}
+	_WriteBarrier();
 
-	for (u32 threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	for (u32 taskIndex = 0; taskIndex < graph->taskCount; ++taskIndex)
 	{
-		DWORD threadID;
-		HANDLE threadHandle = CreateThread(0, 0, threadProc, queue, 0, &threadID);
-		CloseHandle(threadHandle);
+		Task* task = graph->tasks + taskIndex;
+		if (task->dependencyCount == 0)
+		{
+			_pushTask(task);
+		}
 	}
 }
 
@@ -1604,6 +2547,120 @@ static void clearImage2D(Image2D* image)
 	memset(image->memory, 0, image->height*image->pitch);
 }
 
+#define IMAGE_TILES_PER_THREAD 4
+
+struct ImageTiling
+{
+	u32 width;
+	u32 height;
+	u32 tileSizeX;
+	u32 tileSizeY;
+	u32 tileCountX;
+	u32 tileCountY;
+};
+
+static ImageTiling getImageTiling(u32 width, u32 height, u32 pixelSize)
+{
+	//NOTE: a tile should fit into half of the L2, so the other images the kernel touches fit next to it, and there should be
+	// a few tiles per thread for the balancing. Tiles are whole rows if possible, narrower ones stay multiples of 64 pixels for the SIMD kernels
+	ASSERT(g_l2CacheSize > 0 && g_logicalProcessorCount > 0);
+	u32 tileBytes = g_l2CacheSize / 2;
+	u32 minTileCount = IMAGE_TILES_PER_THREAD * g_logicalProcessorCount;
+
+	ImageTiling result = {};
+	result.width = width;
+	result.height = height;
+
+	result.tileSizeX = width;
+	if (width * pixelSize > tileBytes)
+	{
+		result.tileSizeX = MAX(64, (tileBytes / pixelSize) & ~63);
+	}
+	result.tileCountX = (width + result.tileSizeX - 1) / result.tileSizeX;
+
+	u32 minTileCountY = (minTileCount + result.tileCountX - 1) / result.tileCountX;
+	result.tileSizeY = CLAMP(1, height, tileBytes / (result.tileSizeX * pixelSize));
+	result.tileSizeY = MAX(1, MIN(result.tileSizeY, height / minTileCountY));
+	result.tileCountY = (height + result.tileSizeY - 1) / result.tileSizeY;
+
+	return result;
+}
+
+inline u32 getTileCount(ImageTiling* tiling)
+{
+	return tiling->tileCountX * tiling->tileCountY;
+}
+
+inline ClipRect getTileClipRect(ImageTiling* tiling, u32 tileIndex)
+{
+	u32 tileX = tileIndex % tiling->tileCountX;
+	u32 tileY = tileIndex / tiling->tileCountX;
+
+	ClipRect result;
+	result.minX = tileX * tiling->tileSizeX;
+	result.minY = tileY * tiling->tileSizeY;
+	result.maxX = MIN(result.minX + tiling->tileSizeX, tiling->width);
+	result.maxY = MIN(result.minY + tiling->tileSizeY, tiling->height);
+	return result;
+}
+
+typedef void(ImageKernel)(void* data, ClipRect* clipRect);
+
+struct ImageTile
+{
+	ImageKernel* kernel;
+	void* data;
+	ClipRect clipRect;
+};
+
+static void _runImageTile(void* data)
+{
+	ImageTile* tile = (ImageTile*)data;
+	tile->kernel(tile->data, &tile->clipRect);
+}
+
+static Task* addImageTask(MemoryArena* arena, TaskGraph* graph, ImageKernel* kernel, void* data, Image2D* image)
+{
+	//NOTE: a parallel for over the image, every tile is a part of the task
+	ImageTiling tiling = getImageTiling(image->width, image->height, image->pixelSize);
+	u32 tileCount = getTileCount(&tiling);
+
+	ImageTile* tiles = pushArray(arena, tileCount, ImageTile);
+	ASSERT(tiles);
+	for (u32 tileIndex = 0; tileIndex < tileCount; ++tileIndex)
+	{
+		tiles[tileIndex].kernel = kernel;
+		tiles[tileIndex].data = data;
+		tiles[tileIndex].clipRect = getTileClipRect(&tiling, tileIndex);
+	}
+
+	return addTask(arena, graph, _runImageTile, tiles, tileCount, sizeof(ImageTile));
+}
+
+static void _clearImageTile(void* data, ClipRect* clipRect)
+{
+	Image2D* image = (Image2D*)data;
+	u8* row = image->memory + clipRect->minY * image->pitch + clipRect->minX * image->pixelSize;
+	for (u32 y = clipRect->minY; y < clipRect->maxY; ++y)
+	{
+		memset(row, 0, (clipRect->maxX - clipRect->minX) * image->pixelSize);
+		row += image->pitch;
+	}
+}
+
+static void clearImage2D(WorkQueue* queue, Image2D* image)
+{
+	//NOTE: the clear is split like every other pass over the image, so the tiles are touched first by the nodes which later work on them.
+	// That only helps where the OS places a fresh page on the node touching it first, large pages are placed when they are allocated
+	MemoryArena* arena = getScratchArena();
+	TempMemory tempMemory = startTempMemory(arena);
+	TaskGraph graph = {};
+	addImageTask(arena, &graph, _clearImageTile, image, image);
+	submitTaskGraph(queue, &graph, WORK_PRIORITY_HIGH);
+	waitForTaskGraph(&graph);
+	endTempMemory(&tempMemory);
+}
+
 inline v4 unpackColor(u32 color)
 {
 	v4 result =
@@ -1629,6 +2686,52 @@ inline u32 packColor(v4 color)
 	return (a << 24) | (b << 16) | (g << 8) | (r << 0);
 }
 
+#define SRGB_ENCODE_TABLE_SIZE 4096
+
+//NOTE: the decode has an entry for every 8 bit value, the encode is indexed by the rounded linear value
+global f32 g_srgbToLinear[256];
+global u32 g_linearToSrgb[SRGB_ENCODE_TABLE_SIZE];
+
+static void initSrgbTables()
+{
+	for (u32 i = 0; i < ARRAY_SIZE(g_srgbToLinear); ++i)
+	{
+		f32 c = (f32)i / 255.f;
+		g_srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+	for (u32 i = 0; i < ARRAY_SIZE(g_linearToSrgb); ++i)
+	{
+		f32 l = (f32)i / (f32)(SRGB_ENCODE_TABLE_SIZE - 1);
+		f32 c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.f / 2.4f) - 0.055f;
+		g_linearToSrgb[i] = (u32)(c * 255.f + 0.5f);
+	}
+}
+
+inline v4 unpackColorSrgb(u32 color)
+{
+	v4 result =
+	{
+		g_srgbToLinear[(color >> 0) & 255],
+		g_srgbToLinear[(color >> 8) & 255],
+		g_srgbToLinear[(color >> 16) & 255],
+		(f32)((color >> 24) & 255) * (1.f / 255.f) //alpha is linear
+	};
+
+	return result;
+}
+
+inline u32 packColorSrgb(v4 color)
+{
+	color = saturate(color);
+	f32 encodeScale = (f32)(SRGB_ENCODE_TABLE_SIZE - 1);
+	u32 r = g_linearToSrgb[(u32)(color.r * encodeScale + 0.5f)];
+	u32 g = g_linearToSrgb[(u32)(color.g * encodeScale + 0.5f)];
+	u32 b = g_linearToSrgb[(u32)(color.b * encodeScale + 0.5f)];
+	u32 a = (u32)(color.a * 255.f);
+
+	return (a << 24) | (b << 16) | (g << 8) | (r << 0);
+}
+
 inline u32 packNormal(v3 normal)
 {
 	normal = normalize(normal);
@@ -1644,22 +2747,27 @@ inline v3 unpackNormal(u32 normal)
 	return result;
 }
 
-static void fillNormalMapForHeightMap(Image2D* heightMap, Image2D* normalMap)
+static void fillNormalMapForHeightMap(Image2D* heightMap, Image2D* normalMap, ClipRect* clipRect = 0)
 {
 	ASSERT(heightMap->width == normalMap->width);
 	ASSERT(heightMap->height == normalMap->height);
 
+	u32 minX = clipRect ? clipRect->minX : 0;
+	u32 minY = clipRect ? clipRect->minY : 0;
+	u32 maxX = clipRect ? clipRect->maxX : heightMap->width;
+	u32 maxY = clipRect ? clipRect->maxY : heightMap->height;
+
 	f32 pixelSizeX = 1.f / (f32)heightMap->width;
 	f32 pixelSizeY = 1.f / (f32)heightMap->height;
 
-	u8* rowNormal = normalMap->memory;
-	for (u32 y = 0; y < heightMap->height; ++y)
+	u8* rowNormal = normalMap->memory + minY * normalMap->pitch;
+	for (u32 y = minY; y < maxY; ++y)
 	{
 		u32 y0 = (y + heightMap->height- 1) % heightMap->height;
 		u32 y1 = (y + 1) % heightMap->height;
 
-		u32* normal = (u32*)rowNormal;
-		for (u32 x = 0; x < heightMap->width; ++x)
+		u32* normal = (u32*)rowNormal + minX;
+		for (u32 x = minX; x < maxX; ++x)
 		{
 			u32 x0 = (x + heightMap->width- 1) % heightMap->width;
 			u32 x1 = (x + 1) % heightMap->width;
@@ -1691,6 +2799,8 @@ enum IMAGE_EDGE
 
 static Mesh createSphereMesh(MemoryArena* arena, u32 quadCountU, u32 quadCountV)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	Mesh result = {};
 	ASSERT(quadCountV > 1 && quadCountU > 2);
 
@@ -1777,6 +2887,8 @@ static void reverseOrientation(Mesh* mesh)
 
 static Mesh createTorusMesh(MemoryArena* arena, u32 tileCountU, u32 tileCountV, f32 holeRadius)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	Mesh result = {};
 
 	u32 vertexCount = (tileCountU + 1) * (tileCountV + 1);
@@ -1834,6 +2946,8 @@ static Mesh createTorusMesh(MemoryArena* arena, u32 tileCountU, u32 tileCountV,
 
 static Mesh createCubeMesh(MemoryArena* arena)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	Mesh result = {};
 
 	u32 vertexCount = 36;
@@ -1902,6 +3016,8 @@ static Mesh createCubeMesh(MemoryArena* arena)
 
 static Mesh createPlaneMesh(MemoryArena* arena, v2 tileSize, u32 tileCountX, u32 tileCountZ)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	ASSERT(tileCountX > 0);
 	ASSERT(tileCountZ > 0);
 
@@ -1983,35 +3099,6 @@ inline SampleParams1D getSampleParams(u32 width, f32 u) //u is expected to be in
 	return result;
 }
 
-struct SampleParams1DAVX
-{
-	__m256i u0;
-	__m256i u1;
-	__m256 du;
-};
-
-inline SampleParams1DAVX getSampleParams(__m256i width, __m256 u) //u is expected to be in [0,1]
-{
-	SampleParams1DAVX result = {};
-
-	u = u * _mm256_cvtepi32_ps(width);
-	u = u - _mm256_set1_ps(0.5f);
-
-	__m256i u0 = _mm256_cvtps_epi32(_mm256_round_ps(u, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
-	__m256i u1 = _mm256_add_epi32(u0, _mm256_set1_epi32(1));
-	
-	u0 = _mm256_max_epi32(_mm256_min_epi32(_mm256_sub_epi32(width, _mm256_set1_epi32(1)), u0), _mm256_set1_epi32(0));
-	u1 = _mm256_max_epi32(_mm256_min_epi32(_mm256_sub_epi32(width, _mm256_set1_epi32(1)), u1), _mm256_set1_epi32(0));
-
-	__m256 du = _mm256_sub_ps(u, _mm256_cvtepi32_ps(u0));
-
-	result.u0 = u0;
-	result.u1 = u1;
-	result.du = du;
-
-	return result;
-}
-
 union SampleParams2D
 {
 	struct
@@ -2032,36 +3119,6 @@ union SampleParams2D
 
 };
 
-union SampleParams2DAVX
-{
-	struct
-	{
-		__m256i u0;
-		__m256i u1;
-		__m256 du;
-
-		__m256i v0;
-		__m256i v1;
-		__m256 dv;
-	};
-	struct
-	{
-		SampleParams1DAVX paramsU;
-		SampleParams1DAVX paramsV;
-	};
-
-};
-
-inline SampleParams2DAVX getSampleParams(__m256i width, __m256i height, __m256 u, __m256 v) //u and v are expected to be in [0,1]
-{
-	SampleParams2DAVX result = {};
-
-	result.paramsU = getSampleParams(width, u);
-	result.paramsV = getSampleParams(height, v);
-
-	return result;
-}
-
 static SampleParams2D getSampleParams(u32 width, u32 height, f32 u, f32 v)
 {
 	SampleParams2D result = {};
@@ -2070,8 +3127,9 @@ static SampleParams2D getSampleParams(u32 width, u32 height, f32 u, f32 v)
 	return result;
 }
 
-static void generateMipLevels4U8(Image2DLod* image)
+static void generateMipLevels4U8(Image2DLod* image, b32 srgb = false)
 {
+	//NOTE: the reference for generateMipLevels4U8SIMD
 	for (u32 lod = 1; lod < image->lodCount; ++lod)
 	{
 		Image2D* newImage = image->lod + lod;
@@ -2090,17 +3148,21 @@ static void generateMipLevels4U8(Image2DLod* image)
 				f32 u = ((f32)x + 0.5f) / (f32)newImage->width;
 				s.paramsU = getSampleParams(prevImage->width, u);
 
-				v4 c00 = unpackColor(fetchSample(prevImage, s.u0, s.v0, u32));
-				v4 c10 = unpackColor(fetchSample(prevImage, s.u1, s.v0, u32));
-				v4 c01 = unpackColor(fetchSample(prevImage, s.u0, s.v1, u32));
-				v4 c11 = unpackColor(fetchSample(prevImage, s.u1, s.v1, u32));
+				u32 t00 = fetchSample(prevImage, s.u0, s.v0, u32);
+				u32 t10 = fetchSample(prevImage, s.u1, s.v0, u32);
+				u32 t01 = fetchSample(prevImage, s.u0, s.v1, u32);
+				u32 t11 = fetchSample(prevImage, s.u1, s.v1, u32);
+
+				v4 c00 = srgb ? unpackColorSrgb(t00) : unpackColor(t00);
+				v4 c10 = srgb ? unpackColorSrgb(t10) : unpackColor(t10);
+				v4 c01 = srgb ? unpackColorSrgb(t01) : unpackColor(t01);
+				v4 c11 = srgb ? unpackColorSrgb(t11) : unpackColor(t11);
 
 				v4 a = lerp(c00, c10, s.du);
 				v4 b = lerp(c01, c11, s.du);
 				v4 c = lerp(a, b, s.dv);
 
-				*pixel++ = packColor(c);
-
+				*pixel++ = srgb ? packColorSrgb(c) : packColor(c);
 			}
 			row += newImage->pitch;
 		}
@@ -2143,95 +3205,6 @@ static void generateMipLevels1F32(Image2DLod* image)
 	}
 }
 
-static void generateMipLevels1F32AVX(Image2DLod* image)
-{
-	__m256 _0_to_7 = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
-
-	for (u32 lod = 1; lod < image->lodCount; ++lod)
-	{
-		Image2D* newImage = image->lod + lod;
-		Image2D* prevImage = image->lod + (lod - 1);
-
-		ASSERT((newImage->pitch & 31) == 0); //pitch is aligned to avx registers
-
-		__m256 newImageWidth = _mm256_set1_ps((f32)newImage->width);
-		__m256i prevImageWidth = _mm256_set1_epi32(prevImage->width);
-		__m256i prevImagePitch = _mm256_set1_epi32(prevImage->pitch);
-
-		u8* row = newImage->memory;
-		for (u32 y = 0; y < newImage->height; ++y)
-		{
-			f32 v = ((f32)y + 0.5f) / (f32)newImage->height;
-			SampleParams2DAVX s = {};
-			s.paramsV = getSampleParams(_mm256_set1_epi32(prevImage->height), _mm256_set1_ps(v));
-
-			f32* pixel = (f32*)row;
-			for (u32 _x = 0; _x < newImage->width; _x+=8)
-			{
-				__m256 x = _mm256_add_ps(_mm256_set1_ps((f32)_x), _0_to_7);
-
-				__m256 u = (x + _mm256_set1_ps(0.5f)) / newImageWidth;
-				s.paramsU = getSampleParams(prevImageWidth, u);
-
-				__m256i i00 = _mm256_add_epi32(_mm256_mullo_epi32(s.u0, _mm256_set1_epi32(sizeof(f32))), _mm256_mullo_epi32(s.v0, prevImagePitch));
-				__m256i i10 = _mm256_add_epi32(_mm256_mullo_epi32(s.u1, _mm256_set1_epi32(sizeof(f32))), _mm256_mullo_epi32(s.v0, prevImagePitch));
-				__m256i i01 = _mm256_add_epi32(_mm256_mullo_epi32(s.u0, _mm256_set1_epi32(sizeof(f32))), _mm256_mullo_epi32(s.v1, prevImagePitch));
-				__m256i i11 = _mm256_add_epi32(_mm256_mullo_epi32(s.u1, _mm256_set1_epi32(sizeof(f32))), _mm256_mullo_epi32(s.v1, prevImagePitch));
-
-				__m256 c00;
-				c00.m256_f32[0] = *(f32*)(prevImage->memory + i00.m256i_i32[0]);
-				c00.m256_f32[1] = *(f32*)(prevImage->memory + i00.m256i_i32[1]);
-				c00.m256_f32[2] = *(f32*)(prevImage->memory + i00.m256i_i32[2]);
-				c00.m256_f32[3] = *(f32*)(prevImage->memory + i00.m256i_i32[3]);
-				c00.m256_f32[4] = *(f32*)(prevImage->memory + i00.m256i_i32[4]);
-				c00.m256_f32[5] = *(f32*)(prevImage->memory + i00.m256i_i32[5]);
-				c00.m256_f32[6] = *(f32*)(prevImage->memory + i00.m256i_i32[6]);
-				c00.m256_f32[7] = *(f32*)(prevImage->memory + i00.m256i_i32[7]);
-
-				__m256 c10;
-				c10.m256_f32[0] = *(f32*)(prevImage->memory + i10.m256i_i32[0]);
-				c10.m256_f32[1] = *(f32*)(prevImage->memory + i10.m256i_i32[1]);
-				c10.m256_f32[2] = *(f32*)(prevImage->memory + i10.m256i_i32[2]);
-				c10.m256_f32[3] = *(f32*)(prevImage->memory + i10.m256i_i32[3]);
-				c10.m256_f32[4] = *(f32*)(prevImage->memory + i10.m256i_i32[4]);
-				c10.m256_f32[5] = *(f32*)(prevImage->memory + i10.m256i_i32[5]);
-				c10.m256_f32[6] = *(f32*)(prevImage->memory + i10.m256i_i32[6]);
-				c10.m256_f32[7] = *(f32*)(prevImage->memory + i10.m256i_i32[7]);
-
-				__m256 c01;
-				c01.m256_f32[0] = *(f32*)(prevImage->memory + i01.m256i_i32[0]);
-				c01.m256_f32[1] = *(f32*)(prevImage->memory + i01.m256i_i32[1]);
-				c01.m256_f32[2] = *(f32*)(prevImage->memory + i01.m256i_i32[2]);
-				c01.m256_f32[3] = *(f32*)(prevImage->memory + i01.m256i_i32[3]);
-				c01.m256_f32[4] = *(f32*)(prevImage->memory + i01.m256i_i32[4]);
-				c01.m256_f32[5] = *(f32*)(prevImage->memory + i01.m256i_i32[5]);
-				c01.m256_f32[6] = *(f32*)(prevImage->memory + i01.m256i_i32[6]);
-				c01.m256_f32[7] = *(f32*)(prevImage->memory + i01.m256i_i32[7]);
-
-				__m256 c11;
-				c11.m256_f32[0] = *(f32*)(prevImage->memory + i11.m256i_i32[0]);
-				c11.m256_f32[1] = *(f32*)(prevImage->memory + i11.m256i_i32[1]);
-				c11.m256_f32[2] = *(f32*)(prevImage->memory + i11.m256i_i32[2]);
-				c11.m256_f32[3] = *(f32*)(prevImage->memory + i11.m256i_i32[3]);
-				c11.m256_f32[4] = *(f32*)(prevImage->memory + i11.m256i_i32[4]);
-				c11.m256_f32[5] = *(f32*)(prevImage->memory + i11.m256i_i32[5]);
-				c11.m256_f32[6] = *(f32*)(prevImage->memory + i11.m256i_i32[6]);
-				c11.m256_f32[7] = *(f32*)(prevImage->memory + i11.m256i_i32[7]);
-
-
-				__m256 a = lerp(c00, c10, s.du);
-				__m256 b = lerp(c01, c11, s.du);
-				__m256 c = lerp(a, b, s.dv);
-
-				_mm256_store_ps(pixel, c);
-
-				pixel += 8;
-			}
-			row += newImage->pitch;
-		}
-	}
-}
-
 
 struct FractalGrad
 {
@@ -2243,17 +3216,8 @@ struct FractalGrad
 enum IMAGE_STATE
 {
 	IMAGE_STATE_OBSOLETE,
-	IMAGE_STATE_PRECOMPUTING,
-	IMAGE_STATE_COMPUTING,
-	IMAGE_STATE_POSTCOMPUTING,
+	IMAGE_STATE_COMPUTING, //the task graph of the image is in flight
 	IMAGE_STATE_READY,
-
-	//for colored fractal
-	IMAGE_STATE_COMPUTING_CHANNELS,
-
-	//for height map fractal
-	IMAGE_STATE_COMPUTING_HEIGHT_MAP,
-	IMAGE_STATE_COMPUTING_NORMAL_MAP,
 };
 
 struct Fractal;
@@ -2282,7 +3246,9 @@ struct Fractal
 	ComputeFractalWork* works;
 	u32 workCount;
 
-	u32 volatile partsInFlightCount;
+	v2 range; //of the last computed image, before the scaling
+
+	TaskGraph graph; //precompute -> compute -> postcompute -> scale
 	
 	IMAGE_STATE imageState;
 	b32 resetHappened;
@@ -2306,10 +3272,11 @@ struct ColoredFractal
 	Image2DLod im;
 
 	f32 zoomFactor;
+	f32 zoomSpeed;
 	ComputeFractalWork* works;
 	u32 workCount;
 
-	u32 volatile partsInFlightCount;
+	TaskGraph graph; //the pipelines of the channels -> combine, the own graphs of the channels are not used
 
 	IMAGE_STATE imageState;
 	b32 resetHappened;
@@ -2321,7 +3288,7 @@ struct HeightMapFractal
 	Fractal height;
 	Image2DLod normal;
 
-	u32 volatile partsInFlightCount;
+	TaskGraph graph; //the pipeline of the height -> normal map, the own graph of the height is not used
 
 	IMAGE_STATE imageState;
 	b32 resetHappened;
@@ -2541,250 +3508,439 @@ static Terrain createTerrain(ResourceManager* resourceManager, MemoryArena* aren
 }
 #endif
 
-static v2 addPerlinNoiseAVX(Image2D* image, Image2D* grad, u32 gradAlignX, u32 gradAlignY, u32 tileSize, f32 heightScale, ClipRect* clipRect = 0)
+struct PerlinOctave
 {
-	ASSERT(IS_POW2(grad->width) && IS_POW2(grad->height));
-	ASSERT((image->pitch & 31) == 0);
-	if (clipRect)
+	Image2D* grad;
+	u32 gradAlignX;
+	u32 gradAlignY;
+	u32 tileSize;
+	f32 heightScale;
+};
+
+#define PERLIN_MAX_OCTAVE_COUNT 16
+
+static u32 getPerlinOctaves(PerlinOctave* octaves, Image2D* grad, u32 maxTileSize, f32 heightScale)
+{
+	//NOTE: the usual ladder, the tile size and the height halve down to one pixel
+	u32 result = 0;
+	for (u32 tileSize = maxTileSize; tileSize > 0; tileSize >>= 1)
 	{
-		ASSERT((clipRect->minX & 7) == 0);
-		ASSERT((clipRect->maxX & 7) == 0 || clipRect->maxX >= image->width);
+		ASSERT(result < PERLIN_MAX_OCTAVE_COUNT);
+		octaves[result++] = { grad, 0, 0, tileSize, heightScale };
+		heightScale /= 2.f;
 	}
+	return result;
+}
 
-	u32 minX = clipRect ? clipRect->minX : 0;
-	u32 minY = clipRect ? clipRect->minY : 0;
-	u32 maxX = clipRect ? clipRect->maxX : image->width;
-	u32 maxY = clipRect ? clipRect->maxY : image->height;
+static u32 getPerlinOctavesForLod(PerlinOctave* lodOctaves, PerlinOctave* octaves, u32 octaveCount, u32 lod)
+{
+	//NOTE: a pixel of the lod covers 2^lod pixels of lod0, the octaves whose tiles are smaller than that are dropped,
+	// the others are shrunk so that their lattice lands under the same pixel centers as in lod0
+	u32 result = 0;
+	u32 lodMask = (1u << lod) - 1;
+	for (u32 octaveIndex = 0; octaveIndex < octaveCount; ++octaveIndex)
+	{
+		PerlinOctave octave = octaves[octaveIndex];
+		if ((octave.tileSize >> lod) > 0)
+		{
+			ASSERT(((octave.tileSize | octave.gradAlignX | octave.gradAlignY) & lodMask) == 0);
+			octave.tileSize >>= lod;
+			octave.gradAlignX >>= lod;
+			octave.gradAlignY >>= lod;
+			lodOctaves[result++] = octave;
+		}
+	}
+	return result;
+}
+
+#define LANE_WIDTH 4
+#include "image_kernels.h"
+#undef LANE_WIDTH
+#define LANE_WIDTH 8
+#include "image_kernels.h"
+#undef LANE_WIDTH
+#define LANE_WIDTH 16
+#include "image_kernels.h"
+#undef LANE_WIDTH
+
+enum SIMD_LEVEL
+{
+	SIMD_LEVEL_SSE2,
+	SIMD_LEVEL_AVX2,
+	SIMD_LEVEL_AVX512,
+};
 
-	m256v2 range = { _mm256_set1_ps(1e10f), _mm256_set1_ps(-1e10f) };
+global char* g_simdLevelNames[] = { "SSE2", "AVX2", "AVX-512" };
+
+typedef v2(AddPerlinNoiseOctavesKernel)(Image2D* image, PerlinOctave* octaves, u32 octaveCount, ClipRect* clipRect);
+typedef v2(AddPerlinNoiseOctavesWithNormalsKernel)(Image2D* image, PerlinOctave* octaves, u32 octaveCount, Image2D* normalMap, ClipRect* clipRect);
+typedef void(ResampleImageKernel)(Image2D* dest, Image2D* src, ClipRect* clipRect);
+typedef void(ResampleColorImageKernel)(Image2D* dest, Image2D* src, b32 srgb, ClipRect* clipRect);
+typedef void(NormalMapKernel)(Image2D* heightMap, Image2D* normalMap, ClipRect* clipRect);
+typedef void(ScaleImageKernel)(Image2D* image, v2 fromScale, v2 toScale, ClipRect* clipRect);
+typedef void(CombineGrayScaledImagesKernel)(Image2D* dest, Image2D* red, Image2D* green, Image2D* blue, ClipRect* clipRect);
+
+struct ImageKernels
+{
+	SIMD_LEVEL level;
+	AddPerlinNoiseOctavesKernel* addPerlinNoiseOctaves;
+	AddPerlinNoiseOctavesWithNormalsKernel* addPerlinNoiseOctavesWithNormals;
+	ResampleImageKernel* downsample2x2F32;
+	ResampleImageKernel* resampleBilinear1F32;
+	ResampleColorImageKernel* downsample2x2U8x4;
+	ResampleColorImageKernel* resampleBilinearU8x4;
+	NormalMapKernel* fillNormalMap;
+	ScaleImageKernel* scaleImage;
+	CombineGrayScaledImagesKernel* combineGrayScaledImages;
+};
 
-	__m256i gradPitch = _mm256_set1_epi32(grad->pitch);
-	__m256i gradUMask = _mm256_set1_epi32(grad->width - 1);
-	__m256i gradVMask = _mm256_set1_epi32(grad->height - 1);
-	__m256 _0_to_7 = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+//NOTE: the baseline works everywhere, initImageKernels picks the widest variant the cpu has at startup
+global ImageKernels g_imageKernels = { SIMD_LEVEL_SSE2, addPerlinNoiseOctavesSSE2, addPerlinNoiseOctavesWithNormalsSSE2, downsample2x2F32SSE2, resampleBilinear1F32SSE2, downsample2x2U8x4SSE2, resampleBilinearU8x4SSE2, fillNormalMapSSE2, scaleImageSSE2, combineGrayScaledImagesSSE2 };
 
-	__m256 tileSizeScale = _mm256_set1_ps(1.f / (f32)tileSize);
-	__m256 scale = _mm256_set1_ps(heightScale);
+static SIMD_LEVEL getSupportedSimdLevel()
+{
+	//NOTE: the cpu has to have the instructions and the OS has to save the wider registers on a context switch (XCR0)
+	SIMD_LEVEL result = SIMD_LEVEL_SSE2; //every x64 cpu has it
 
-	u8* row = image->memory + minX * sizeof(f32) + minY * image->pitch;
-	for (u32 _y = minY; _y < maxY; ++_y)
+	s32 info[4];
+	__cpuid(info, 0);
+	s32 maxLeaf = info[0];
+	__cpuid(info, 1);
+	b32 osxsave = (info[2] >> 27) & 1;
+	b32 avx = (info[2] >> 28) & 1;
+	if (maxLeaf >= 7 && osxsave && avx)
 	{
-		__m256 y = _mm256_set1_ps((f32)_y);
-		__m256 v = (y - _mm256_set1_ps((f32)gradAlignY - 0.5f)) * tileSizeScale;
-		__m256i v0 = _mm256_cvtps_epi32(_mm256_round_ps(v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
-		__m256i v1 = _mm256_add_epi32(v0, _mm256_set1_epi32(1));
-		__m256 dv = _mm256_sub_ps(v, _mm256_cvtepi32_ps(v0));
-		v0 = _mm256_and_si256(v0, gradVMask);
-		v1 = _mm256_and_si256(v1, gradVMask);
+		u64 xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		b32 avx2 = (info[1] >> 5) & 1;
+		b32 avx512f = (info[1] >> 16) & 1;
 
-		f32* pixel = (f32*)row;
-		for (u32 _x = minX; _x < maxX; _x += 8)
-		{
-			__m256 pixelValue = _mm256_load_ps(pixel);
-
-			__m256 x = _mm256_set1_ps((f32)_x) + _0_to_7;
-
-			__m256 u = (x - _mm256_set1_ps((f32)gradAlignX - 0.5f)) * tileSizeScale;
-			__m256i u0 = _mm256_cvtps_epi32(_mm256_round_ps(u, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
-			__m256i u1 = _mm256_add_epi32(u0, _mm256_set1_epi32(1));
-			__m256 du = _mm256_sub_ps(u, _mm256_cvtepi32_ps(u0));
-			u0 = _mm256_and_si256(u0, gradUMask);
-			u1 = _mm256_and_si256(u1, gradUMask);
-
-			__m256i i00 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(sizeof(v2)), u0), _mm256_mullo_epi32(v0, gradPitch));
-			__m256i i10 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(sizeof(v2)), u1), _mm256_mullo_epi32(v0, gradPitch));
-			__m256i i01 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(sizeof(v2)), u0), _mm256_mullo_epi32(v1, gradPitch));
-			__m256i i11 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(sizeof(v2)), u1), _mm256_mullo_epi32(v1, gradPitch));
-
-			//t00
-			m256v2 t00;
-			t00.x.m256_f32[0] = *(f32*)(grad->memory + i00.m256i_i32[0]);
-			t00.x.m256_f32[1] = *(f32*)(grad->memory + i00.m256i_i32[1]);
-			t00.x.m256_f32[2] = *(f32*)(grad->memory + i00.m256i_i32[2]);
-			t00.x.m256_f32[3] = *(f32*)(grad->memory + i00.m256i_i32[3]);
-			t00.x.m256_f32[4] = *(f32*)(grad->memory + i00.m256i_i32[4]);
-			t00.x.m256_f32[5] = *(f32*)(grad->memory + i00.m256i_i32[5]);
-			t00.x.m256_f32[6] = *(f32*)(grad->memory + i00.m256i_i32[6]);
-			t00.x.m256_f32[7] = *(f32*)(grad->memory + i00.m256i_i32[7]);
-
-			t00.y.m256_f32[0] = *(f32*)(grad->memory + i00.m256i_i32[0] + sizeof(f32));
-			t00.y.m256_f32[1] = *(f32*)(grad->memory + i00.m256i_i32[1] + sizeof(f32));
-			t00.y.m256_f32[2] = *(f32*)(grad->memory + i00.m256i_i32[2] + sizeof(f32));
-			t00.y.m256_f32[3] = *(f32*)(grad->memory + i00.m256i_i32[3] + sizeof(f32));
-			t00.y.m256_f32[4] = *(f32*)(grad->memory + i00.m256i_i32[4] + sizeof(f32));
-			t00.y.m256_f32[5] = *(f32*)(grad->memory + i00.m256i_i32[5] + sizeof(f32));
-			t00.y.m256_f32[6] = *(f32*)(grad->memory + i00.m256i_i32[6] + sizeof(f32));
-			t00.y.m256_f32[7] = *(f32*)(grad->memory + i00.m256i_i32[7] + sizeof(f32));
-
-			//t01
-			m256v2 t01;
-			t01.x.m256_f32[0] = *(f32*)(grad->memory + i01.m256i_i32[0]);
-			t01.x.m256_f32[1] = *(f32*)(grad->memory + i01.m256i_i32[1]);
-			t01.x.m256_f32[2] = *(f32*)(grad->memory + i01.m256i_i32[2]);
-			t01.x.m256_f32[3] = *(f32*)(grad->memory + i01.m256i_i32[3]);
-			t01.x.m256_f32[4] = *(f32*)(grad->memory + i01.m256i_i32[4]);
-			t01.x.m256_f32[5] = *(f32*)(grad->memory + i01.m256i_i32[5]);
-			t01.x.m256_f32[6] = *(f32*)(grad->memory + i01.m256i_i32[6]);
-			t01.x.m256_f32[7] = *(f32*)(grad->memory + i01.m256i_i32[7]);
-
-			t01.y.m256_f32[0] = *(f32*)(grad->memory + i01.m256i_i32[0] + sizeof(f32));
-			t01.y.m256_f32[1] = *(f32*)(grad->memory + i01.m256i_i32[1] + sizeof(f32));
-			t01.y.m256_f32[2] = *(f32*)(grad->memory + i01.m256i_i32[2] + sizeof(f32));
-			t01.y.m256_f32[3] = *(f32*)(grad->memory + i01.m256i_i32[3] + sizeof(f32));
-			t01.y.m256_f32[4] = *(f32*)(grad->memory + i01.m256i_i32[4] + sizeof(f32));
-			t01.y.m256_f32[5] = *(f32*)(grad->memory + i01.m256i_i32[5] + sizeof(f32));
-			t01.y.m256_f32[6] = *(f32*)(grad->memory + i01.m256i_i32[6] + sizeof(f32));
-			t01.y.m256_f32[7] = *(f32*)(grad->memory + i01.m256i_i32[7] + sizeof(f32));
-
-			//t10
-			m256v2 t10;
-			t10.x.m256_f32[0] = *(f32*)(grad->memory + i10.m256i_i32[0]);
-			t10.x.m256_f32[1] = *(f32*)(grad->memory + i10.m256i_i32[1]);
-			t10.x.m256_f32[2] = *(f32*)(grad->memory + i10.m256i_i32[2]);
-			t10.x.m256_f32[3] = *(f32*)(grad->memory + i10.m256i_i32[3]);
-			t10.x.m256_f32[4] = *(f32*)(grad->memory + i10.m256i_i32[4]);
-			t10.x.m256_f32[5] = *(f32*)(grad->memory + i10.m256i_i32[5]);
-			t10.x.m256_f32[6] = *(f32*)(grad->memory + i10.m256i_i32[6]);
-			t10.x.m256_f32[7] = *(f32*)(grad->memory + i10.m256i_i32[7]);
-
-			t10.y.m256_f32[0] = *(f32*)(grad->memory + i10.m256i_i32[0] + sizeof(f32));
-			t10.y.m256_f32[1] = *(f32*)(grad->memory + i10.m256i_i32[1] + sizeof(f32));
-			t10.y.m256_f32[2] = *(f32*)(grad->memory + i10.m256i_i32[2] + sizeof(f32));
-			t10.y.m256_f32[3] = *(f32*)(grad->memory + i10.m256i_i32[3] + sizeof(f32));
-			t10.y.m256_f32[4] = *(f32*)(grad->memory + i10.m256i_i32[4] + sizeof(f32));
-			t10.y.m256_f32[5] = *(f32*)(grad->memory + i10.m256i_i32[5] + sizeof(f32));
-			t10.y.m256_f32[6] = *(f32*)(grad->memory + i10.m256i_i32[6] + sizeof(f32));
-			t10.y.m256_f32[7] = *(f32*)(grad->memory + i10.m256i_i32[7] + sizeof(f32));
-
-			//t11
-			m256v2 t11;
-			t11.x.m256_f32[0] = *(f32*)(grad->memory + i11.m256i_i32[0]);
-			t11.x.m256_f32[1] = *(f32*)(grad->memory + i11.m256i_i32[1]);
-			t11.x.m256_f32[2] = *(f32*)(grad->memory + i11.m256i_i32[2]);
-			t11.x.m256_f32[3] = *(f32*)(grad->memory + i11.m256i_i32[3]);
-			t11.x.m256_f32[4] = *(f32*)(grad->memory + i11.m256i_i32[4]);
-			t11.x.m256_f32[5] = *(f32*)(grad->memory + i11.m256i_i32[5]);
-			t11.x.m256_f32[6] = *(f32*)(grad->memory + i11.m256i_i32[6]);
-			t11.x.m256_f32[7] = *(f32*)(grad->memory + i11.m256i_i32[7]);
-
-			t11.y.m256_f32[0] = *(f32*)(grad->memory + i11.m256i_i32[0] + sizeof(f32));
-			t11.y.m256_f32[1] = *(f32*)(grad->memory + i11.m256i_i32[1] + sizeof(f32));
-			t11.y.m256_f32[2] = *(f32*)(grad->memory + i11.m256i_i32[2] + sizeof(f32));
-			t11.y.m256_f32[3] = *(f32*)(grad->memory + i11.m256i_i32[3] + sizeof(f32));
-			t11.y.m256_f32[4] = *(f32*)(grad->memory + i11.m256i_i32[4] + sizeof(f32));
-			t11.y.m256_f32[5] = *(f32*)(grad->memory + i11.m256i_i32[5] + sizeof(f32));
-			t11.y.m256_f32[6] = *(f32*)(grad->memory + i11.m256i_i32[6] + sizeof(f32));
-			t11.y.m256_f32[7] = *(f32*)(grad->memory + i11.m256i_i32[7] + sizeof(f32));
-
-
-			__m256 a = smoothBlend2(dot(t00, { du, dv }), dot(t10, { du - _mm256_set1_ps(1.f), dv }), du);
-			__m256 b = smoothBlend2(dot(t01, { du, dv - _mm256_set1_ps(1.f) }), dot(t11, { du - _mm256_set1_ps(1.f), dv - _mm256_set1_ps(1.f) }), du);
-			__m256 c = smoothBlend2(a, b, dv);
-
-			pixelValue = pixelValue + scale * c;
-
-			range.x = _mm256_min_ps(pixelValue, range.x);
-			range.y = _mm256_max_ps(pixelValue, range.y);
-
-			_mm256_store_ps(pixel, pixelValue);
-			pixel += 8;
+		if (avx2 && (xcr0 & 0x6) == 0x6) //xmm, ymm
+		{
+			result = SIMD_LEVEL_AVX2;
+			if (avx512f && (xcr0 & 0xe6) == 0xe6) //opmask, upper zmm, zmm16-31
+			{
+				result = SIMD_LEVEL_AVX512;
+			}
 		}
-		row += image->pitch;
 	}
+	return result;
+}
+
+static void initImageKernels(SIMD_LEVEL maxLevel)
+{
+	SIMD_LEVEL supportedLevel = getSupportedSimdLevel();
+	SIMD_LEVEL level = MIN(supportedLevel, maxLevel);
+
+	initSrgbTables();
+
+	g_imageKernels.level = level;
+	switch (level)
+	{
+		case SIMD_LEVEL_SSE2:
+		{
+			g_imageKernels.addPerlinNoiseOctaves = addPerlinNoiseOctavesSSE2;
+			g_imageKernels.addPerlinNoiseOctavesWithNormals = addPerlinNoiseOctavesWithNormalsSSE2;
+			g_imageKernels.downsample2x2F32 = downsample2x2F32SSE2;
+			g_imageKernels.resampleBilinear1F32 = resampleBilinear1F32SSE2;
+			g_imageKernels.downsample2x2U8x4 = downsample2x2U8x4SSE2;
+			g_imageKernels.resampleBilinearU8x4 = resampleBilinearU8x4SSE2;
+			g_imageKernels.fillNormalMap = fillNormalMapSSE2;
+			g_imageKernels.scaleImage = scaleImageSSE2;
+			g_imageKernels.combineGrayScaledImages = combineGrayScaledImagesSSE2;
+		} break;
+		case SIMD_LEVEL_AVX2:
+		{
+			g_imageKernels.addPerlinNoiseOctaves = addPerlinNoiseOctavesAVX2;
+			g_imageKernels.addPerlinNoiseOctavesWithNormals = addPerlinNoiseOctavesWithNormalsAVX2;
+			g_imageKernels.downsample2x2F32 = downsample2x2F32AVX2;
+			g_imageKernels.resampleBilinear1F32 = resampleBilinear1F32AVX2;
+			g_imageKernels.downsample2x2U8x4 = downsample2x2U8x4AVX2;
+			g_imageKernels.resampleBilinearU8x4 = resampleBilinearU8x4AVX2;
+			g_imageKernels.fillNormalMap = fillNormalMapAVX2;
+			g_imageKernels.scaleImage = scaleImageAVX2;
+			g_imageKernels.combineGrayScaledImages = combineGrayScaledImagesAVX2;
+		} break;
+		case SIMD_LEVEL_AVX512:
+		{
+			g_imageKernels.addPerlinNoiseOctaves = addPerlinNoiseOctavesAVX512;
+			g_imageKernels.addPerlinNoiseOctavesWithNormals = addPerlinNoiseOctavesWithNormalsAVX512;
+			g_imageKernels.downsample2x2F32 = downsample2x2F32AVX512;
+			g_imageKernels.resampleBilinear1F32 = resampleBilinear1F32AVX512;
+			g_imageKernels.downsample2x2U8x4 = downsample2x2U8x4AVX512;
+			g_imageKernels.resampleBilinearU8x4 = resampleBilinearU8x4AVX512;
+			g_imageKernels.fillNormalMap = fillNormalMapAVX512;
+			g_imageKernels.scaleImage = scaleImageAVX512;
+			g_imageKernels.combineGrayScaledImages = combineGrayScaledImagesAVX512;
+		} break;
+		default: ASSERT(false);
+	}
+
+	char buffer[256];
+	sprintf_s(buffer, "Image kernels: %s (cpu supports %s%s)\n", g_simdLevelNames[level], g_simdLevelNames[supportedLevel],
+		level < supportedLevel ? ", lowered from the command line" : "");
+	OutputDebugStringA(buffer);
+}
+
+inline v2 addPerlinNoiseOctavesSIMD(Image2D* image, PerlinOctave* octaves, u32 octaveCount, ClipRect* clipRect = 0)
+{
+	return g_imageKernels.addPerlinNoiseOctaves(image, octaves, octaveCount, clipRect);
+}
+
+inline v2 addPerlinNoiseOctavesWithNormalsSIMD(Image2D* image, PerlinOctave* octaves, u32 octaveCount, Image2D* normalMap, ClipRect* clipRect = 0)
+{
+	return g_imageKernels.addPerlinNoiseOctavesWithNormals(image, octaves, octaveCount, normalMap, clipRect);
+}
+
+inline v2 addPerlinNoiseSIMD(Image2D* image, Image2D* grad, u32 gradAlignX, u32 gradAlignY, u32 tileSize, f32 heightScale, ClipRect* clipRect = 0)
+{
+	PerlinOctave octave = { grad, gradAlignX, gradAlignY, tileSize, heightScale };
+	return g_imageKernels.addPerlinNoiseOctaves(image, &octave, 1, clipRect);
+}
+
+struct MipLevelWork
+{
+	Image2D* dest;
+	Image2D* src;
+	b32 srgb;
+};
+
+inline b32 isExactHalving(MipLevelWork* work)
+{
+	return work->src->width == 2 * work->dest->width && work->src->height == 2 * work->dest->height;
+}
+
+static void _generateMipLevelTile1F32(void* data, ClipRect* clipRect)
+{
+	MipLevelWork* work = (MipLevelWork*)data;
+	if (isExactHalving(work))
+	{
+		g_imageKernels.downsample2x2F32(work->dest, work->src, clipRect);
+	}
+	else
+	{
+		g_imageKernels.resampleBilinear1F32(work->dest, work->src, clipRect);
+	}
+}
+
+static void _generateMipLevelTile4U8(void* data, ClipRect* clipRect)
+{
+	MipLevelWork* work = (MipLevelWork*)data;
+	if (isExactHalving(work))
+	{
+		g_imageKernels.downsample2x2U8x4(work->dest, work->src, work->srgb, clipRect);
+	}
+	else
+	{
+		g_imageKernels.resampleBilinearU8x4(work->dest, work->src, work->srgb, clipRect);
+	}
+}
+
+static void generateMipLevels(WorkQueue* queue, Image2DLod* image, ImageKernel* tileKernel, b32 srgb)
+{
+	//NOTE: a task per lod, split into bands of rows, every lod waits for the one it is made from
+	MemoryArena* arena = getScratchArena();
+	TempMemory tempMemory = startTempMemory(arena);
+	TaskGraph graph = {};
+	MipLevelWork* works = pushArray(arena, image->lodCount, MipLevelWork);
+	Task* prevTask = 0;
+	for (u32 lod = 1; lod < image->lodCount; ++lod)
+	{
+		works[lod].dest = image->lod + lod;
+		works[lod].src = image->lod + (lod - 1);
+		works[lod].srgb = srgb;
+		Task* task = addImageTask(arena, &graph, tileKernel, works + lod, works[lod].dest);
+		if (prevTask)
+		{
+			addDependency(task, prevTask);
+		}
+		prevTask = task;
+	}
+	if (prevTask)
+	{
+		submitTaskGraph(queue, &graph, WORK_PRIORITY_HIGH);
+		waitForTaskGraph(&graph);
+	}
+	endTempMemory(&tempMemory);
+}
+
+inline void generateMipLevels1F32SIMD(WorkQueue* queue, Image2DLod* image)
+{
+	generateMipLevels(queue, image, _generateMipLevelTile1F32, false);
+}
+
+inline void generateMipLevels4U8SIMD(WorkQueue* queue, Image2DLod* image, b32 srgb = false)
+{
+	//NOTE: the exact halvings average the four texels at once instead of the nested lerps (and in integers without sRGB),
+	// a channel can be one off from generateMipLevels4U8 there (see downsample2x2U8x4). The other sizes give the same result
+	generateMipLevels(queue, image, _generateMipLevelTile4U8, srgb);
+}
+
+inline void fillNormalMapForHeightMapSIMD(Image2D* heightMap, Image2D* normalMap, ClipRect* clipRect = 0)
+{
+	g_imageKernels.fillNormalMap(heightMap, normalMap, clipRect);
+}
+
+struct NormalMapWork
+{
+	Image2D* heightMap;
+	Image2D* normalMap;
+};
+
+static void _fillNormalMapTile(void* data, ClipRect* clipRect)
+{
+	NormalMapWork* work = (NormalMapWork*)data;
+	g_imageKernels.fillNormalMap(work->heightMap, work->normalMap, clipRect);
+}
+
+static void fillNormalMapsForHeightMapSIMD(WorkQueue* queue, Image2DLod* heightMap, Image2DLod* normalMap, u32 firstLod = 0)
+{
+	//NOTE: every lod is independent, all their tiles go to the queue at once
+	ASSERT(heightMap->lodCount == normalMap->lodCount);
+	ASSERT(firstLod < heightMap->lodCount);
+	MemoryArena* arena = getScratchArena();
+	TempMemory tempMemory = startTempMemory(arena);
+	TaskGraph graph = {};
+	NormalMapWork* works = pushArray(arena, heightMap->lodCount, NormalMapWork);
+	for (u32 lod = firstLod; lod < heightMap->lodCount; ++lod)
+	{
+		works[lod].heightMap = heightMap->lod + lod;
+		works[lod].normalMap = normalMap->lod + lod;
+		addImageTask(arena, &graph, _fillNormalMapTile, works + lod, works[lod].normalMap);
+	}
+	submitTaskGraph(queue, &graph, WORK_PRIORITY_HIGH);
+	waitForTaskGraph(&graph);
+	endTempMemory(&tempMemory);
+}
 
-	v2 result = { 1e10f, -1e10f };
-	for (u32 simdIndex = 0; simdIndex < 8; ++simdIndex)
+static void fillNormalMapEdgesForHeightMapSIMD(Image2D* heightMap, Image2D* normalMap, u32 edgeWidth)
+{
+	//NOTE: the columns and the rows within edgeWidth of the edges, the columns are widened to whole lanes of the widest kernel
+	u32 width = heightMap->width;
+	u32 height = heightMap->height;
+	u32 leftMaxX = MIN(width, (u32)ALIGN_NUM(edgeWidth, 16));
+	u32 rightMinX = MAX(leftMaxX, (width - MIN(width, edgeWidth)) & ~15u);
+	u32 rowCount = MIN(height, edgeWidth);
+	ClipRect edges[] =
 	{
-		result.x = MIN(result.x, range.x.m256_f32[simdIndex]);
-		result.y = MAX(result.y, range.y.m256_f32[simdIndex]);
+		{ 0, leftMaxX, 0, height },
+		{ rightMinX, width, 0, height },
+		{ leftMaxX, rightMinX, 0, rowCount },
+		{ leftMaxX, rightMinX, height - rowCount, height },
+	};
+	for (u32 edgeIndex = 0; edgeIndex < ARRAY_SIZE(edges); ++edgeIndex)
+	{
+		if (edges[edgeIndex].minX < edges[edgeIndex].maxX)
+		{
+			g_imageKernels.fillNormalMap(heightMap, normalMap, edges + edgeIndex);
+		}
 	}
-
-	return result;
 }
 
-static void scaleImageAVX(Image2D* image, v2 fromScale, v2 toScale)
+struct NoiseLodWork
 {
-	f32 _a = (toScale.y - toScale.x) / (fromScale.y - fromScale.x);
-	f32 _b = toScale.x - _a * fromScale.x;
-
-	__m256 a = _mm256_set1_ps(_a);
-	__m256 b = _mm256_set1_ps(_b);
+	Image2D* image;
+	Image2D* normalMap;
+	PerlinOctave octaves[PERLIN_MAX_OCTAVE_COUNT];
+	u32 octaveCount;
+};
 
-	u8* row = image->memory;
-	ASSERT(image->width % 8 == 0); //just for simplicity
-	for (u32 y = 0; y < image->height; ++y)
+static void _synthesizeNoiseLodTile(void* data, ClipRect* clipRect)
+{
+	NoiseLodWork* work = (NoiseLodWork*)data;
+	_clearImageTile(work->image, clipRect);
+	if (work->octaveCount == 0)
 	{
-		__m256* pixel = (__m256*)row;
-		for (u32 x = 0; x < image->width; x += 8)
+		//NOTE: every octave is finer than a pixel, the lod stays flat
+		if (work->normalMap)
 		{
-			*pixel++ = a * (*pixel) + b;
+			g_imageKernels.fillNormalMap(work->image, work->normalMap, clipRect);
 		}
-		row += image->pitch;
+	}
+	else if (work->normalMap)
+	{
+		g_imageKernels.addPerlinNoiseOctavesWithNormals(work->image, work->octaves, work->octaveCount, work->normalMap, clipRect);
+	}
+	else
+	{
+		g_imageKernels.addPerlinNoiseOctaves(work->image, work->octaves, work->octaveCount, clipRect);
 	}
 }
 
-static void combineGrayScaledImagesAVX(Image2D* dest, Image2D* red, Image2D* green, Image2D* blue)
+static void synthesizeNoiseLodsSIMD(WorkQueue* queue, Image2DLod* image, Image2DLod* normalMap, PerlinOctave* octaves, u32 octaveCount)
 {
-	//make sky colored, use fractal height and normal map for sphere, 3D perlin noise
-
-	ASSERT(dest->width == red->width && dest->width == green->width && dest->width == blue->width);
-	ASSERT(dest->height == red->height && dest->height == green->height && dest->height == blue->height);
-
-	ASSERT((dest->pitch & 31) == 0);
-	ASSERT((red->pitch & 31) == 0);
-	ASSERT((green->pitch & 31) == 0);
-	ASSERT((blue->pitch & 31) == 0);
+	//NOTE: every lod gets the noise of the octaves it can show instead of a downsampled lod0,
+	// the coarse lods go to the queue first so they are the first to be done
+	ASSERT(!normalMap || normalMap->lodCount == image->lodCount);
+	MemoryArena* arena = getScratchArena();
+	TempMemory tempMemory = startTempMemory(arena);
+	TaskGraph graph = {};
+	NoiseLodWork* works = pushArray(arena, image->lodCount, NoiseLodWork);
+	for (u32 lod = image->lodCount; lod-- > 0;)
+	{
+		works[lod].image = image->lod + lod;
+		works[lod].normalMap = normalMap ? normalMap->lod + lod : 0;
+		works[lod].octaveCount = getPerlinOctavesForLod(works[lod].octaves, octaves, octaveCount, lod);
+		addImageTask(arena, &graph, _synthesizeNoiseLodTile, works + lod, works[lod].image);
+	}
+	submitTaskGraph(queue, &graph, WORK_PRIORITY_HIGH);
+	waitForTaskGraph(&graph);
+	endTempMemory(&tempMemory);
+}
 
-	u8* destRow = dest->memory;  
-	u8* redRow = red->memory; 
-	u8* greenRow = green->memory; 
-	u8* blueRow = blue->memory;  
+inline void scaleImageSIMD(Image2D* image, v2 fromScale, v2 toScale, ClipRect* clipRect = 0)
+{
+	g_imageKernels.scaleImage(image, fromScale, toScale, clipRect);
+}
 
-	__m256i alpha = _mm256_slli_epi32(_mm256_set1_epi32(/*255*/0), 24);
+inline void combineGrayScaledImagesSIMD(Image2D* dest, Image2D* red, Image2D* green, Image2D* blue, ClipRect* clipRect = 0)
+{
+	g_imageKernels.combineGrayScaledImages(dest, red, green, blue, clipRect);
+}
 
-	for (u32 y = 0; y < dest->height; ++y)
-	{
-		u32* destPixel = (u32*)destRow;
-		f32* redPixel = (f32*)redRow;
-		f32* greenPixel = (f32*)greenRow;
-		f32* bluePixel = (f32*)blueRow;
-		for (u32 x = 0; x < dest->width; x += 8)
-		{
-			__m256 rf = _mm256_load_ps(redPixel);
-			__m256 gf = _mm256_load_ps(greenPixel);
-			__m256 bf = _mm256_load_ps(bluePixel);
+static void precomputeFractal(void* data);
+static void computeFractal(void* data);
+static void postComputeFractal(void* data);
+static void scaleFractal(void* data, ClipRect* clipRect);
+static void postComputeColoredFractal(void* data);
+static void combineColoredFractal(void* data, ClipRect* clipRect);
+static void computeFractalNormalMap(void* data);
+static void fillFractalNormalMap(void* data, ClipRect* clipRect);
 
-			rf = rf * _mm256_set1_ps(255.f);
-			gf = gf * _mm256_set1_ps(255.f);
-			bf = bf * _mm256_set1_ps(255.f);
+static Task* addFractalTasks(MemoryArena* arena, TaskGraph* graph, Fractal* fractal)
+{
+	//NOTE: into the graph which is submitted for the fractal, its own for a standalone one, the parent's for a channel or a height
+	Task* precompute = addTask(arena, graph, precomputeFractal, fractal);
+	Task* compute = addTask(arena, graph, computeFractal, fractal->works, fractal->workCount, sizeof(ComputeFractalWork));
+	Task* postCompute = addTask(arena, graph, postComputeFractal, fractal);
+	Task* scale = addImageTask(arena, graph, scaleFractal, fractal, &fractal->im.lod[0]);
 
-			rf = _mm256_max_ps(_mm256_set1_ps(0.f), _mm256_min_ps(_mm256_set1_ps(255.f), rf));
-			gf = _mm256_max_ps(_mm256_set1_ps(0.f), _mm256_min_ps(_mm256_set1_ps(255.f), gf));
-			bf = _mm256_max_ps(_mm256_set1_ps(0.f), _mm256_min_ps(_mm256_set1_ps(255.f), bf));
+	addDependency(compute, precompute);
+	addDependency(postCompute, compute);
+	addDependency(scale, postCompute);
 
-			__m256i ri = _mm256_cvtps_epi32(_mm256_round_ps(rf, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-			__m256i gi = _mm256_cvtps_epi32(_mm256_round_ps(gf, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
-			__m256i bi = _mm256_cvtps_epi32(_mm256_round_ps(bf, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	return scale;
+}
 
-			gi = _mm256_slli_epi32(gi, 8);
-			bi = _mm256_slli_epi32(bi, 16);
-			__m256i color = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(ri, gi), bi), alpha);
-			_mm256_store_si256((__m256i*)destPixel, color);
-			
-			destPixel += 8;
-			redPixel += 8;
-			greenPixel += 8;
-			bluePixel += 8;
-		}
-		destRow += dest->pitch;
-		redRow += red->pitch;
-		greenRow += green->pitch;
-		blueRow += blue->pitch;
+static u32 getFractalOctaves(Fractal* fractal, PerlinOctave* octaves)
+{
+	//NOTE: the grads are a ring, the octave with the biggest tiles starts at currentBaseGradIndex
+	u32 result = 0;
+	f32 scale = 1.f;
+	for (u32 tileSize = fractal->maxTileSize; tileSize > 0; tileSize >>= 1)
+	{
+		ASSERT(result < ARRAY_SIZE(fractal->grads));
+		FractalGrad* grad = fractal->grads + (fractal->currentBaseGradIndex + result) % ARRAY_SIZE(fractal->grads);
+		octaves[result++] = { &grad->grad, (u32)grad->gridAlignX, (u32)grad->gridAlignY, tileSize, scale };
+		scale /= 2.f;
 	}
+	return result;
 }
 
-static void createFractal(MemoryArena* arena, Fractal* result, f32 zoomSpeed, u32 seed, u32 width, u32 height, u32 maxTileSize)
+static void createFractal(WorkQueue* queue, MemoryArena* arena, Fractal* result, f32 zoomSpeed, u32 seed, u32 width, u32 height, u32 maxTileSize)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	*result = {};
 
 	result->zoomFactor = 1.f;
@@ -2794,27 +3950,15 @@ static void createFractal(MemoryArena* arena, Fractal* result, f32 zoomSpeed, u3
 
 	result->im = pushImage2DLod(arena, width, height, f32, 2);
 
-	u32 computeTileSizeX = 1024;
-	u32 computeTileSizeY = 512;
-	u32 workCountX = (width + computeTileSizeX - 1) / computeTileSizeX;
-	u32 workCountY = (height + computeTileSizeY - 1) / computeTileSizeY;
-	
-	result->workCount = workCountX * workCountY;
+	ImageTiling tiling = getImageTiling(width, height, sizeof(f32));
+	result->workCount = getTileCount(&tiling);
 	result->works = pushArray(arena, result->workCount, ComputeFractalWork);
 
-	ComputeFractalWork* work = result->works;
-	for (u32 workIndexX = 0; workIndexX < workCountX; ++workIndexX)
+	for (u32 workIndex = 0; workIndex < result->workCount; ++workIndex)
 	{
-		for (u32 workIndexY = 0; workIndexY < workCountY; ++workIndexY)
-		{
-			work->fractal = result;
-			work->clipRect.minX = computeTileSizeX * workIndexX;
-			work->clipRect.minY = computeTileSizeY * workIndexY;
-			work->clipRect.maxX = MIN(computeTileSizeX * (workIndexX + 1), width);
-			work->clipRect.maxY = MIN(computeTileSizeY * (workIndexY + 1), height);
-
-			++work;
-		}
+		ComputeFractalWork* work = result->works + workIndex;
+		work->fractal = result;
+		work->clipRect = getTileClipRect(&tiling, workIndex);
 	}
 
 
@@ -2826,49 +3970,66 @@ static void createFractal(MemoryArena* arena, Fractal* result, f32 zoomSpeed, u3
 		fillWithRandomGradients(&result->grads[gradIndex].grad, seed + gradIndex);
 	}
 
-	clearImage2D(&result->im.lod[0]);
+	clearImage2D(queue, &result->im.lod[0]);
 	result->maxTileSize = maxTileSize;
-	u32 tileSize = result->maxTileSize;
-	v2 range = {};
-	f32 scale = 1.f;
-	for (u32 iter = 0; tileSize > 0; ++iter)
-	{
-		ASSERT(iter < ARRAY_SIZE(result->grads));
-		FractalGrad* grad = result->grads + iter;
-		range = addPerlinNoiseAVX(&result->im.lod[0], &grad->grad, grad->gridAlignX, grad->gridAlignY, tileSize, scale);
-		tileSize >>= 1;
-		scale /= 2.f;
-		++result->layerCount;
-	}
-	scaleImageAVX(&result->im.lod[0], range, { 0.f, 1.f });
+	PerlinOctave octaves[ARRAY_SIZE(result->grads)];
+	result->layerCount = getFractalOctaves(result, octaves);
+	v2 range = addPerlinNoiseOctavesSIMD(&result->im.lod[0], octaves, result->layerCount);
+	scaleImageSIMD(&result->im.lod[0], range, { 0.f, 1.f });
 }
 
-static void createColoredFractal(MemoryArena* arena, ColoredFractal* result, f32 zoomSpeed, u32 seed, u32 width, u32 height, u32 maxTileSize)
+static void createColoredFractal(WorkQueue* queue, MemoryArena* arena, ColoredFractal* result, f32 zoomSpeed, u32 seed, u32 width, u32 height, u32 maxTileSize)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
+	*result = {};
+
 	result->zoomFactor = 1.f;
+	result->zoomSpeed = zoomSpeed;
 	result->imageState = IMAGE_STATE_OBSOLETE;
-	result->shouldRecompute = false;
+	result->shouldRecompute = true;
 
 
 	for (u32 channelIndex = 0; channelIndex < 3; ++channelIndex)
 	{
-		createFractal(arena, &result->channels[channelIndex], zoomSpeed, seed + channelIndex, width, height, maxTileSize);
+		createFractal(queue, arena, &result->channels[channelIndex], zoomSpeed, seed + channelIndex, width, height, maxTileSize);
 	}
 
 	result->works = result->red.works; //just stealing it from one channel TODO:should we separate the parts (interface) of a fractal which used by the GPU fractal?
 	result->workCount = result->blue.workCount;
 	result->im = pushImage2DLod(arena, width, height, u32, 2);
-	combineGrayScaledImagesAVX(&result->im.lod[0], &result->red.im.lod[0], &result->green.im.lod[0], &result->blue.im.lod[0]);
+	clearImage2D(queue, &result->im.lod[0]);
+	combineGrayScaledImagesSIMD(&result->im.lod[0], &result->red.im.lod[0], &result->green.im.lod[0], &result->blue.im.lod[0]);
+
+	//NOTE: the copy to lod1 only reads the previous combined image, so it runs next to the channels
+	Task* postCompute = addTask(arena, &result->graph, postComputeColoredFractal, result);
+	Task* combine = addImageTask(arena, &result->graph, combineColoredFractal, result, &result->im.lod[0]);
+	addDependency(combine, postCompute);
+	for (u32 channelIndex = 0; channelIndex < 3; ++channelIndex)
+	{
+		addDependency(combine, addFractalTasks(arena, &result->graph, &result->channels[channelIndex]));
+	}
 }
 
-static void createHeightMapFractal(MemoryArena* arena, HeightMapFractal* result, f32 zoomSpeed, u32 seed, u32 width, u32 height, u32 maxTileSize)
+static void createHeightMapFractal(WorkQueue* queue, MemoryArena* arena, HeightMapFractal* result, f32 zoomSpeed, u32 seed, u32 width, u32 height, u32 maxTileSize)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
+	*result = {};
+
 	result->imageState = IMAGE_STATE_OBSOLETE;
-	result->shouldRecompute = false;
+	result->shouldRecompute = true;
 
-	createFractal(arena, &result->height, zoomSpeed, seed, width, height, maxTileSize);
+	createFractal(queue, arena, &result->height, zoomSpeed, seed, width, height, maxTileSize);
 
 	result->normal = pushImage2DLod(arena, width, height, u32, 2);
+	clearImage2D(queue, &result->normal.lod[0]);
+
+	//NOTE: the copy to lod1 only reads the previous normal map, so it runs next to the height
+	Task* normalMap = addTask(arena, &result->graph, computeFractalNormalMap, result);
+	Task* fillNormalMap = addImageTask(arena, &result->graph, fillFractalNormalMap, result, &result->normal.lod[0]);
+	addDependency(fillNormalMap, normalMap);
+	addDependency(fillNormalMap, addFractalTasks(arena, &result->graph, &result->height));
 }
 
 static GPUFractal createGPUFractal(ResourceManager* resourceManager, Fractal* fractal)
@@ -2969,8 +4130,6 @@ static void precomputeFractal(void* data)
 	//endTicketMutex(&g_randMutex);
 
 	clearImage2D(&fractal->im.lod[0]);
-
-	_InterlockedDecrement((volatile LONG*)&fractal->partsInFlightCount);
 }
 
 static void computeFractal(void* data)
@@ -2979,19 +4138,14 @@ static void computeFractal(void* data)
 	Fractal* fractal = work->fractal;
 	ClipRect* clipRect = &work->clipRect;
 
-	u32 tileSize = fractal->maxTileSize;
-	f32 scale = 1.f;
-	v2 range = {};
-	for (u32 iter = 0; tileSize > 0; ++iter)
+	//NOTE: a tile is a cache sized piece of the image, all the octaves of it are done in one go
+	if (runningTaskCancelled())
 	{
-		FractalGrad* grad = fractal->grads + (fractal->currentBaseGradIndex + iter) % ARRAY_SIZE(fractal->grads);
-		range = addPerlinNoiseAVX(&fractal->im.lod[0], &grad->grad, grad->gridAlignX, grad->gridAlignY, tileSize, scale, clipRect);
-		scale /= 2.f;
-		tileSize >>= 1;
+		return;
 	}
-	work->range = range;
-
-_InterlockedDecrement((volatile LONG*)&fractal->partsInFlightCount);
+	PerlinOctave octaves[ARRAY_SIZE(fractal->grads)];
+	u32 octaveCount = getFractalOctaves(fractal, octaves);
+	work->range = addPerlinNoiseOctavesSIMD(&fractal->im.lod[0], octaves, octaveCount, clipRect);
 }
 
 static void postComputeFractal(void* data)
@@ -3007,13 +4161,46 @@ static void postComputeFractal(void* data)
 		range.y = MAX(range.y, work->range.y);
 	}
 
-	scaleImageAVX(&fractal->im.lod[0], range, { 0.f, 1.f });
-	_InterlockedDecrement((volatile LONG*)&fractal->partsInFlightCount);
+	fractal->range = range;
+}
+
+static void scaleFractal(void* data, ClipRect* clipRect)
+{
+	if (runningTaskCancelled())
+	{
+		return;
+	}
+	Fractal* fractal = (Fractal*)data;
+	scaleImageSIMD(&fractal->im.lod[0], fractal->range, { 0.f, 1.f }, clipRect);
 }
 
 
 
 
+#define FRACTAL_DEADLINE_MARGIN 0.25f //seconds
+#define FRACTAL_LATE_HELP_BUDGET 0.002f //seconds a frame helps a late generation before it lets it be for this frame
+
+static b32 helpLateFractalGeneration(TaskGraph* graph)
+{
+	//NOTE: the generation in flight is exactly the image the reset needs, it goes to high priority and gets our help for a few ms.
+	// A part already started is not interrupted, so the budget can be overrun by one part
+	raiseTaskGraphPriority(graph, WORK_PRIORITY_HIGH);
+	LARGE_INTEGER start = Win32GetWallClock();
+	helpingWaitWhile(graph->queue, !taskGraphFinished(graph) && Win32GetSecondsElapsed(start, Win32GetWallClock()) < FRACTAL_LATE_HELP_BUDGET);
+	return taskGraphFinished(graph);
+}
+
+static void raisePriorityNearDeadline(TaskGraph* graph, f32 zoomFactor, f32 zoomSpeed)
+{
+	//NOTE: the zoom shrinks by (1 - dt*zoomSpeed) every frame, so it hits the reset at 0.5 in about log(2*zoomFactor)/zoomSpeed seconds.
+	// The image is background work until then, close to the reset it becomes latency critical
+	f32 secondsUntilReset = logf(2.f * zoomFactor) / zoomSpeed;
+	if (secondsUntilReset < FRACTAL_DEADLINE_MARGIN)
+	{
+		raiseTaskGraphPriority(graph, WORK_PRIORITY_HIGH);
+	}
+}
+
 static void updateFractal(WorkQueue* queue, Fractal* fractal, f32 dt)
 {
 	fractal->zoomFactor *= MAX(0.5f, 1.f - dt * fractal->zoomSpeed);
@@ -3025,34 +4212,14 @@ static void updateFractal(WorkQueue* queue, Fractal* fractal, f32 dt)
 		repeat = false;
 		if (fractal->imageState == IMAGE_STATE_OBSOLETE && fractal->shouldRecompute)
 		{
-			ASSERT(fractal->partsInFlightCount == 0);
-			fractal->partsInFlightCount = 1;
-			_WriteBarrier();
-			pushEntry(queue, fractal, precomputeFractal);
-			fractal->imageState = IMAGE_STATE_PRECOMPUTING;
+			submitTaskGraph(queue, &fractal->graph, WORK_PRIORITY_LOW);
+			fractal->imageState = IMAGE_STATE_COMPUTING;
 			fractal->shouldRecompute = false;
 
 			fractal->DEBUGstartComputeTime = Win32GetWallClock();
 
 		}
-		else if (fractal->imageState == IMAGE_STATE_PRECOMPUTING && fractal->partsInFlightCount == 0)
-		{
-			fractal->partsInFlightCount = fractal->workCount;
-			_WriteBarrier();
-			for (u32 workIndex = 0; workIndex < fractal->workCount; ++workIndex)
-			{
-				pushEntry(queue, fractal->works + workIndex, computeFractal);
-			}
-			fractal->imageState = IMAGE_STATE_COMPUTING;
-		}
-		else if (fractal->imageState == IMAGE_STATE_COMPUTING && fractal->partsInFlightCount == 0)
-		{
-			fractal->partsInFlightCount = 1;
-			_WriteBarrier();
-			pushEntry(queue, fractal, postComputeFractal);
-			fractal->imageState = IMAGE_STATE_POSTCOMPUTING;
-		}
-		else if (fractal->imageState == IMAGE_STATE_POSTCOMPUTING && fractal->partsInFlightCount == 0)
+		else if (fractal->imageState == IMAGE_STATE_COMPUTING && taskGraphFinished(&fractal->graph))
 		{
 			fractal->imageState = IMAGE_STATE_READY;
 			f32 computeTime = Win32GetSecondsElapsed(fractal->DEBUGstartComputeTime, Win32GetWallClock());
@@ -3061,19 +4228,28 @@ static void updateFractal(WorkQueue* queue, Fractal* fractal, f32 dt)
 			OutputDebugStringA(buff);
 		}
 
+		if (fractal->imageState == IMAGE_STATE_COMPUTING)
+		{
+			raisePriorityNearDeadline(&fractal->graph, fractal->zoomFactor, fractal->zoomSpeed);
+		}
+
 		if (fractal->zoomFactor < 0.5f)
 		{
-			if (fractal->imageState == IMAGE_STATE_PRECOMPUTING ||
-				fractal->imageState == IMAGE_STATE_COMPUTING ||
-				fractal->imageState == IMAGE_STATE_POSTCOMPUTING
-				)
+			if (fractal->imageState == IMAGE_STATE_COMPUTING)
 			{
-				//NOTE: this shouldn't happen, but if it does, we have to block until the image is ready
-
+				//NOTE: this shouldn't happen, but if it does, the frame doesn't wait for the whole generation. If the help is not enough,
+				// the zoom holds at the reset and the last ready image stays on the screen until the generation is done
 				START_TIMER(WaitForFractalImage);
-				busyWaitWhile(fractal->partsInFlightCount != 0);
+				b32 finished = helpLateFractalGeneration(&fractal->graph);
 				END_TIMER(WaitForFractalImage);
-				repeat = true;
+				if (finished)
+				{
+					repeat = true;
+				}
+				else
+				{
+					fractal->zoomFactor = 0.5f;
+				}
 			}
 			else
 			{
@@ -3104,9 +4280,16 @@ static void postComputeColoredFractal(void* data)
 			lod0Row += fractal->im.lod[0].pitch;
 		}
 	}
-	combineGrayScaledImagesAVX(&fractal->im.lod[0], &fractal->red.im.lod[0], &fractal->green.im.lod[0], &fractal->blue.im.lod[0]);
+}
 
-	_InterlockedDecrement((volatile LONG*)&fractal->partsInFlightCount);
+static void combineColoredFractal(void* data, ClipRect* clipRect)
+{
+	if (runningTaskCancelled())
+	{
+		return;
+	}
+	ColoredFractal* fractal = (ColoredFractal*)data;
+	combineGrayScaledImagesSIMD(&fractal->im.lod[0], &fractal->red.im.lod[0], &fractal->green.im.lod[0], &fractal->blue.im.lod[0], clipRect);
 }
 
 static void computeFractalNormalMap(void* data)
@@ -3134,15 +4317,21 @@ static void computeFractalNormalMap(void* data)
 			lod0Row += fractal->normal.lod[0].pitch;
 		}
 	}
+}
 
-	fillNormalMapForHeightMap(&fractal->height.im.lod[0], &fractal->normal.lod[0]);
-
-	_InterlockedDecrement((volatile LONG*)&fractal->partsInFlightCount);
+static void fillFractalNormalMap(void* data, ClipRect* clipRect)
+{
+	if (runningTaskCancelled())
+	{
+		return;
+	}
+	HeightMapFractal* fractal = (HeightMapFractal*)data;
+	fillNormalMapForHeightMapSIMD(&fractal->height.im.lod[0], &fractal->normal.lod[0], clipRect);
 }
 
 static void updateFractal(WorkQueue* queue, HeightMapFractal* fractal, f32 dt)
 {
-	updateFractal(queue, &fractal->height, dt);
+	fractal->height.zoomFactor *= MAX(0.5f, 1.f - dt * fractal->height.zoomSpeed);
 
 	b32 repeat = true;
 	while (repeat)
@@ -3151,44 +4340,41 @@ static void updateFractal(WorkQueue* queue, HeightMapFractal* fractal, f32 dt)
 
 		if (fractal->imageState == IMAGE_STATE_OBSOLETE && fractal->shouldRecompute)
 		{
+			submitTaskGraph(queue, &fractal->graph, WORK_PRIORITY_LOW);
+			fractal->imageState = IMAGE_STATE_COMPUTING;
 			fractal->shouldRecompute = false;
-
-			ASSERT(fractal->height.imageState == IMAGE_STATE_READY);
-			fractal->height.shouldRecompute = true;
-			fractal->height.imageState = IMAGE_STATE_OBSOLETE;
-
-			fractal->imageState = IMAGE_STATE_COMPUTING_HEIGHT_MAP;
 		}
-		if (fractal->imageState == IMAGE_STATE_COMPUTING_HEIGHT_MAP && fractal->height.imageState == IMAGE_STATE_READY)
+		else if (fractal->imageState == IMAGE_STATE_COMPUTING && taskGraphFinished(&fractal->graph))
 		{
-			fractal->partsInFlightCount = 1;
-			_WriteBarrier();
-			pushEntry(queue, fractal, computeFractalNormalMap);
-			fractal->imageState = IMAGE_STATE_COMPUTING_NORMAL_MAP;
+			fractal->imageState = IMAGE_STATE_READY;
 		}
-		if (fractal->imageState == IMAGE_STATE_COMPUTING_NORMAL_MAP && fractal->partsInFlightCount == 0)
+
+		if (fractal->imageState == IMAGE_STATE_COMPUTING)
 		{
-			fractal->imageState = IMAGE_STATE_READY;
+			raisePriorityNearDeadline(&fractal->graph, fractal->height.zoomFactor, fractal->height.zoomSpeed);
 		}
-		if (fractal->height.resetHappened)
+
+		if (fractal->height.zoomFactor < 0.5f)
 		{
-			if (fractal->imageState == IMAGE_STATE_COMPUTING_HEIGHT_MAP ||
-				fractal->imageState == IMAGE_STATE_COMPUTING_NORMAL_MAP
-				)
+			if (fractal->imageState == IMAGE_STATE_COMPUTING)
 			{
-				ASSERT(fractal->height.imageState == IMAGE_STATE_READY);
-
-				//NOTE: this shouldn't happen, but if it does, we have to block until the image is ready
-
+				//NOTE: this shouldn't happen, but if it does, the frame doesn't wait for the whole generation. If the help is not enough,
+				// the zoom holds at the reset and the last ready image stays on the screen until the generation is done
 				START_TIMER(WaitForHeightMapFractalImage);
-				busyWaitWhile(fractal->partsInFlightCount != 0);
+				b32 finished = helpLateFractalGeneration(&fractal->graph);
 				END_TIMER(WaitForHeightMapFractalImage);
-				repeat = true;
+				if (finished)
+				{
+					repeat = true;
+				}
+				else
+				{
+					fractal->height.zoomFactor = 0.5f;
+				}
 			}
 			else
 			{
-				fractal->height.resetHappened = false;
-
+				fractal->height.zoomFactor *= 2.f;
 				fractal->resetHappened = true;
 				ASSERT(fractal->shouldRecompute == false);
 				fractal->shouldRecompute = true;
@@ -3199,49 +4385,21 @@ static void updateFractal(WorkQueue* queue, HeightMapFractal* fractal, f32 dt)
 
 static void updateFractal(WorkQueue* queue, ColoredFractal* fractal, f32 dt)
 {
-	updateFractal(queue, &fractal->channels[0], dt);
-	updateFractal(queue, &fractal->channels[1], dt);
-	updateFractal(queue, &fractal->channels[2], dt);
-
-	fractal->zoomFactor = fractal->red.zoomFactor;
+	fractal->zoomFactor *= MAX(0.5f, 1.f - dt * fractal->zoomSpeed);
 
 	b32 repeat = true;
 	while (repeat)
 	{
 		repeat = false;
-		if (fractal->shouldRecompute && fractal->imageState == IMAGE_STATE_OBSOLETE)
+		if (fractal->imageState == IMAGE_STATE_OBSOLETE && fractal->shouldRecompute)
 		{
+			submitTaskGraph(queue, &fractal->graph, WORK_PRIORITY_LOW);
+			fractal->imageState = IMAGE_STATE_COMPUTING;
 			fractal->shouldRecompute = false;
 
-			ASSERT(fractal->channels[0].imageState == IMAGE_STATE_READY);
-			ASSERT(fractal->channels[1].imageState == IMAGE_STATE_READY);
-			ASSERT(fractal->channels[2].imageState == IMAGE_STATE_READY);
-
-			fractal->channels[0].imageState = IMAGE_STATE_OBSOLETE;
-			fractal->channels[1].imageState = IMAGE_STATE_OBSOLETE;
-			fractal->channels[2].imageState = IMAGE_STATE_OBSOLETE;
-
-			fractal->channels[0].shouldRecompute = true;
-			fractal->channels[1].shouldRecompute = true;
-			fractal->channels[2].shouldRecompute = true;
-
-			fractal->imageState = IMAGE_STATE_COMPUTING_CHANNELS;
-
 			fractal->DEBUGstartComputeTime = Win32GetWallClock();
 		}
-
-		if (fractal->imageState == IMAGE_STATE_COMPUTING_CHANNELS &&
-			fractal->channels[0].imageState == IMAGE_STATE_READY &&
-			fractal->channels[1].imageState == IMAGE_STATE_READY &&
-			fractal->channels[2].imageState == IMAGE_STATE_READY
-			)
-		{
-			fractal->partsInFlightCount = 1;
-			_WriteBarrier();
-			pushEntry(queue, fractal, postComputeColoredFractal);
-			fractal->imageState = IMAGE_STATE_POSTCOMPUTING;
-		}
-		if (fractal->imageState == IMAGE_STATE_POSTCOMPUTING && fractal->partsInFlightCount == 0)
+		else if (fractal->imageState == IMAGE_STATE_COMPUTING && taskGraphFinished(&fractal->graph))
 		{
 			fractal->imageState = IMAGE_STATE_READY;
 			f32 computeTime = Win32GetSecondsElapsed(fractal->DEBUGstartComputeTime, Win32GetWallClock());
@@ -3250,38 +4408,36 @@ static void updateFractal(WorkQueue* queue, ColoredFractal* fractal, f32 dt)
 			OutputDebugStringA(buff);
 		}
 
-		if (fractal->red.resetHappened)
+		if (fractal->imageState == IMAGE_STATE_COMPUTING)
 		{
-			ASSERT(fractal->blue.resetHappened && fractal->green.resetHappened);
-			
+			raisePriorityNearDeadline(&fractal->graph, fractal->zoomFactor, fractal->zoomSpeed);
+		}
 
-			if (fractal->imageState == IMAGE_STATE_COMPUTING_CHANNELS ||
-				fractal->imageState == IMAGE_STATE_POSTCOMPUTING
-				)
+		if (fractal->zoomFactor < 0.5f)
+		{
+			if (fractal->imageState == IMAGE_STATE_COMPUTING)
 			{
-				ASSERT(fractal->channels[0].imageState == IMAGE_STATE_READY);
-				ASSERT(fractal->channels[1].imageState == IMAGE_STATE_READY);
-				ASSERT(fractal->channels[2].imageState == IMAGE_STATE_READY);
-
-				//NOTE: this shouldn't happen, but if it does, we have to block until the image is ready
-
+				//NOTE: this shouldn't happen, but if it does, the frame doesn't wait for the whole generation. If the help is not enough,
+				// the zoom holds at the reset and the last ready image stays on the screen until the generation is done
 				START_TIMER(WaitForColoredFractalImage);
-				busyWaitWhile(fractal->partsInFlightCount != 0);
+				b32 finished = helpLateFractalGeneration(&fractal->graph);
 				END_TIMER(WaitForColoredFractalImage);
-				repeat = true;
+				if (finished)
+				{
+					repeat = true;
+				}
+				else
+				{
+					fractal->zoomFactor = 0.5f;
+				}
 			}
 			else
 			{
-				fractal->channels[0].resetHappened = false;
-				fractal->channels[1].resetHappened = false;
-				fractal->channels[2].resetHappened = false;
-
+				fractal->zoomFactor *= 2.f;
 				fractal->resetHappened = true;
 				ASSERT(fractal->shouldRecompute == false);
 				fractal->shouldRecompute = true;
 			}
-
-
 		}
 	}
 }
@@ -3299,38 +4455,20 @@ inline f32 sample2D1F32(Image2D* image, SampleParams2D s)
 	return c;
 }
 
-static HeightMap createHeightMapForSphere(MemoryArena* arena, u32 width, u32 height, u32 gradSeed, f32 heightScale, u32 maxIterCount = 0xffffffff)
+enum HEIGHT_MAP_LODS
 {
-	TIMED_BLOCK();
-
-	HeightMap result = {};
-
-	result.height = pushImage2DLod(arena, width, height, f32);
-	result.normal = pushImage2DLod(arena, width, height, u32);
-
-	TempMemory temp = startTempMemory(arena);
-	Image2D north = pushImage2D(arena, width, height, f32);
-	Image2D south = pushImage2D(arena, width, height, f32);
-
-	Image2D northGrad = pushImage2D(arena, 64, 64, v2);
-	Image2D southGrad = pushImage2D(arena, 64, 64, v2);
-
-	fillWithRandomGradients(&northGrad, gradSeed);
-	fillWithRandomGradients(&southGrad, gradSeed);
+	HEIGHT_MAP_LODS_DOWNSAMPLED, //lod0 gets every octave, the other lods are filtered from it
+	HEIGHT_MAP_LODS_SYNTHESIZED, //every lod gets only the octaves which are at least a pixel big in it
+	HEIGHT_MAP_LODS_DOWNSAMPLED_NOISE_NORMALS, //like downsampled, but the noise sweep also gives lod0 its exact normals. Slower, only the torus has it
+};
 
-	clearImage2D(&result.height.lod[0]);
-	u32 tileSize = 1024;
-	f32 scale = heightScale;
-	while (tileSize)
-	{
-		addPerlinNoiseAVX(&north, &northGrad, 0, 0, tileSize, scale);
-		addPerlinNoiseAVX(&south, &southGrad, 0, 0, tileSize, scale);
-		tileSize >>= 1;
-		scale /= 2.f;
-	}
+static void blendSphereHemispheres(Image2D* dest, Image2D* north, Image2D* south)
+{
+	u32 width = dest->width;
+	u32 height = dest->height;
 
-	u8* rowNorth = north.memory;
-	u8* rowDst= result.height.lod[0].memory;
+	u8* rowNorth = north->memory;
+	u8* rowDst= dest->memory;
 
 	for (u32 y = 0; y < height; ++y)
 	{
@@ -3350,25 +4488,71 @@ static HeightMap createHeightMapForSphere(MemoryArena* arena, u32 width, u32 hei
 				v2 uvInv = (MAX(0.f, 0.99f-r)/r)*uv;
 				uvInv = 0.5f*uvInv + v2{ 0.5f, 0.5f };
 				SampleParams2D s = getSampleParams(width, height, uvInv.x, uvInv.y);
-				southSampl = sample2D1F32(&south, s);
+				southSampl = sample2D1F32(south, s);
 			}
 
 			f32 t = CLAMP(0.f, 1.f, 2.f*(r - 0.5f) + 0.5f);
 			*pixelDst++ = smoothBlend2(northSampl, southSampl, r);
 		}
-		rowNorth += north.pitch;
-		rowDst += result.height.lod[0].pitch;
+		rowNorth += north->pitch;
+		rowDst += dest->pitch;
 	}
+}
 
-	START_TIMER(GenerateMipLevelsForHeightMap);
-	generateMipLevels1F32AVX(&result.height);
-	END_TIMER(GenerateMipLevelsForHeightMap);
+static HeightMap createHeightMapForSphere(WorkQueue* queue, MemoryArena* arena, u32 width, u32 height, u32 gradSeed, f32 heightScale,
+	HEIGHT_MAP_LODS lodMode = HEIGHT_MAP_LODS_DOWNSAMPLED, u32 maxIterCount = 0xffffffff)
+{
+	TIMED_BLOCK();
+	TAGGED_ARENA_BLOCK(arena);
 
-	START_TIMER(GenerateNormalMapFromHeightMap);
-	for (u32 lod = 0; lod < result.height.lodCount; ++lod)
+	HeightMap result = {};
+
+	result.height = pushImage2DLod(arena, width, height, f32);
+	result.normal = pushImage2DLod(arena, width, height, u32);
+
+	TempMemory temp = startTempMemory(arena);
+	Image2D northGrad = pushImage2D(arena, 64, 64, v2);
+	Image2D southGrad = pushImage2D(arena, 64, 64, v2);
+
+	fillWithRandomGradients(&northGrad, gradSeed);
+	fillWithRandomGradients(&southGrad, gradSeed);
+
+	PerlinOctave northOctaves[PERLIN_MAX_OCTAVE_COUNT];
+	PerlinOctave southOctaves[PERLIN_MAX_OCTAVE_COUNT];
+	u32 octaveCount = getPerlinOctaves(northOctaves, &northGrad, 1024, heightScale);
+	getPerlinOctaves(southOctaves, &southGrad, 1024, heightScale);
+
+	if (lodMode == HEIGHT_MAP_LODS_SYNTHESIZED)
+	{
+		//NOTE: the blend is not linear, so the hemispheres are synthesized at every lod and each lod is blended on its own
+		Image2DLod north = pushImage2DLod(arena, width, height, f32);
+		Image2DLod south = pushImage2DLod(arena, width, height, f32);
+		synthesizeNoiseLodsSIMD(queue, &north, 0, northOctaves, octaveCount);
+		synthesizeNoiseLodsSIMD(queue, &south, 0, southOctaves, octaveCount);
+
+		for (u32 lod = result.height.lodCount; lod-- > 0;)
+		{
+			blendSphereHemispheres(result.height.lod + lod, north.lod + lod, south.lod + lod);
+		}
+	}
+	else
 	{
-		fillNormalMapForHeightMap(&result.height.lod[lod], &result.normal.lod[lod]);
+		Image2D north = pushImage2D(arena, width, height, f32);
+		Image2D south = pushImage2D(arena, width, height, f32);
+
+		clearImage2D(&result.height.lod[0]);
+		addPerlinNoiseOctavesSIMD(&north, northOctaves, octaveCount);
+		addPerlinNoiseOctavesSIMD(&south, southOctaves, octaveCount);
+
+		blendSphereHemispheres(&result.height.lod[0], &north, &south);
+
+		START_TIMER(GenerateMipLevelsForHeightMap);
+		generateMipLevels1F32SIMD(queue, &result.height);
+		END_TIMER(GenerateMipLevelsForHeightMap);
 	}
+
+	START_TIMER(GenerateNormalMapFromHeightMap);
+	fillNormalMapsForHeightMapSIMD(queue, &result.height, &result.normal);
 	END_TIMER(GenerateNormalMapFromHeightMap);
 
 	endTempMemory(&temp);
@@ -3376,8 +4560,11 @@ static HeightMap createHeightMapForSphere(MemoryArena* arena, u32 width, u32 hei
 	return result;
 }
 
-static HeightMap createHeightMapForTorus(MemoryArena* arena, u32 width, u32 height, u32 gradSeed, f32 heightScale, u32 maxIterCount = 0xffffffff)
+static HeightMap createHeightMapForTorus(WorkQueue* queue, MemoryArena* arena, u32 width, u32 height, u32 gradSeed, f32 heightScale,
+	HEIGHT_MAP_LODS lodMode = HEIGHT_MAP_LODS_DOWNSAMPLED, u32 maxIterCount = 0xffffffff)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	HeightMap result = {};
 
 	TIMED_BLOCK();
@@ -3389,25 +4576,55 @@ static HeightMap createHeightMapForTorus(MemoryArena* arena, u32 width, u32 heig
 	Image2D grad = pushImage2D(arena, 64, 64, v2);
 
 	fillWithRandomGradients(&grad, gradSeed);
-	clearImage2D(&result.height.lod[0]);
-	u32 tileSize = 1024;
-	f32 scale = heightScale;
-	while (tileSize)
+	PerlinOctave octaves[PERLIN_MAX_OCTAVE_COUNT];
+	u32 octaveCount = getPerlinOctaves(octaves, &grad, 1024, heightScale);
+
+	if (lodMode == HEIGHT_MAP_LODS_SYNTHESIZED)
 	{
-		addPerlinNoiseAVX(&result.height.lod[0], &grad, 0, 0, tileSize, scale);
-		tileSize >>= 1;
-		scale /= 2.f;
+		synthesizeNoiseLodsSIMD(queue, &result.height, &result.normal, octaves, octaveCount);
+
+		//NOTE: every lod is wrapped with its share of the blend, the lods too small for a blend pixel stay as they are
+		for (u32 lod = result.height.lodCount; lod-- > 0;)
+		{
+			Image2D* lodHeight = result.height.lod + lod;
+			u32 blendPixelCount = lodHeight->width / 36;
+			if (blendPixelCount > 0 && 2 * blendPixelCount < MIN(lodHeight->width, lodHeight->height))
+			{
+				wrapImage1F32(lodHeight, false, blendPixelCount);
+				wrapImage1F32(lodHeight, true, blendPixelCount);
+				fillNormalMapEdgesForHeightMapSIMD(lodHeight, result.normal.lod + lod, blendPixelCount + 2);
+			}
+		}
 	}
+	else
+	{
+		b32 noiseNormals = lodMode == HEIGHT_MAP_LODS_DOWNSAMPLED_NOISE_NORMALS;
+		clearImage2D(&result.height.lod[0]);
+		if (noiseNormals)
+		{
+			addPerlinNoiseOctavesWithNormalsSIMD(&result.height.lod[0], octaves, octaveCount, &result.normal.lod[0]);
+		}
+		else
+		{
+			addPerlinNoiseOctavesSIMD(&result.height.lod[0], octaves, octaveCount);
+		}
 
-	u32 blendPixelCount = width / 36;
-	wrapImage1F32(&result.height.lod[0], false, blendPixelCount);
-	wrapImage1F32(&result.height.lod[0], true, blendPixelCount);
+		u32 blendPixelCount = width / 36;
+		wrapImage1F32(&result.height.lod[0], false, blendPixelCount);
+		wrapImage1F32(&result.height.lod[0], true, blendPixelCount);
 
-	generateMipLevels1F32AVX(&result.height);
+		generateMipLevels1F32SIMD(queue, &result.height);
 
-	for (u32 lod = 0; lod < result.height.lodCount; ++lod)
-	{
-		fillNormalMapForHeightMap(&result.height.lod[lod], &result.normal.lod[lod]);
+		if (noiseNormals)
+		{
+			//NOTE: the noise gave lod0 its normals, only the blended edges (and the pixel next to them) are redone from the heights
+			fillNormalMapEdgesForHeightMapSIMD(&result.height.lod[0], &result.normal.lod[0], blendPixelCount + 2);
+			fillNormalMapsForHeightMapSIMD(queue, &result.height, &result.normal, 1);
+		}
+		else
+		{
+			fillNormalMapsForHeightMapSIMD(queue, &result.height, &result.normal);
+		}
 	}
 
 	endTempMemory(&temp);
@@ -5387,14 +6604,10 @@ static f32 dot(Matrix v, Matrix w)
 static void computepFromdq(MemoryArena* arena, PendulumPartialResult* data)
 {
 	//p = A * dq + b
-	TempMemory temp = startTempMemory(arena);
-
 	Matrix dq = wrapToVector(data->dq->e, data->pieceCount * 2);
 	Matrix p = wrapToVector(data->p->e, data->pieceCount * 2);
 
 	add(p, multiply(arena, data->A, dq), data->b);
-
-	endTempMemory(&temp);
 }
 
 static Matrixd toMatrixd(Matrixd result, Matrix A)
@@ -5431,8 +6644,6 @@ static Matrix toMatrix(Matrix result, Matrixd A)
 static void computedqFromp(MemoryArena* arena, PendulumPartialResult* data)
 {
 	//dq = inv(A) * (p - b)
-	TempMemory temp = startTempMemory(arena);
-
 	Matrixd p = toMatrixd(arena, wrapToVector(data->p->e, data->pieceCount * 2));
 	Matrixd dq = pushMatrixd(arena, data->pieceCount * 2, 1);
 	
@@ -5447,8 +6658,6 @@ static void computedqFromp(MemoryArena* arena, PendulumPartialResult* data)
 	//
 	//solveByGauss(arena, dq, data->A, subtract(arena, p, data->b));
 	//multiply(dq, invertByGauss(arena, data->A), subtract(arena, p, data->b));
-
-	endTempMemory(&temp);
 }
 
 static void createdAdqAtBase(Matrix* duPart, Matrix* dvPart, MemoryArena* arena, Pendulum* pendulum, PendulumPartialResult* data, u32 r)
@@ -5550,11 +6759,7 @@ static f32 quadraticForm(MemoryArena* arena, Matrix v, Matrix A, Matrix w) //< v
 	ASSERT(v.columnCount == 1 && w.columnCount == 1);
 	ASSERT(v.rowCount == A.rowCount && w.rowCount == A.columnCount);
 
-	TempMemory temp = startTempMemory(arena);
-
 	f32 result = dot(v, multiply(arena, A, w));
-
-	endTempMemory(&temp);
 	return result;
 }
 
@@ -5562,7 +6767,6 @@ static void computedHdqAtBase(MemoryArena* arena, Pendulum* pendulum, PendulumPa
 {
 	// dH/dq = 0.5 * < p - b, dinvA/dq * p - b > + dV/dq = -0.5 * < dq, dA/dq * dq > + dV/dq
 
-	TempMemory temp = startTempMemory(arena);
 	Matrix dAdqu = pushMatrix(arena, pendulum->pieceCount * 2, pendulum->pieceCount * 2);
 	Matrix dAdqv = pushMatrix(arena, pendulum->pieceCount * 2, pendulum->pieceCount * 2);
 
@@ -5590,8 +6794,6 @@ static void computedHdqAtBase(MemoryArena* arena, Pendulum* pendulum, PendulumPa
 		data->dHdq[pieceIndex] = dHdq;
 		//ASSERT(length(dHdq) < 1000.f);
 	}
-
-	endTempMemory(&temp);
 }
 
 static void validateNumbers(f32* numbers, u32 count)
@@ -5608,21 +6810,22 @@ static void validateMatrix(Matrix A)
 	validateNumbers(A.data, A.rowCount*A.columnCount);
 }
 
+//NOTE: arena is the frame arena, the routines of an iteration push their scratch without popping it and it all goes at the end of the iteration
 static void updatePendulum(MemoryArena* arena, Pendulum* pendulum, v3 dpivot, f32 dt)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	u32 iterCount = 30;
 	dt /= (f32)iterCount;
 
 	v3 dpivotStart = pendulum->dpivot;
 	v3 dpivotEnd = dpivot;
 
-	TempMemory temp = startTempMemory(arena);
-
 	PendulumPartialResult data = pushPendulumPartialResult(arena, pendulum);
 
 	for (u32 iter = 0; iter < iterCount; ++iter)
 	{
-		umm arenaOffset = arena->offset;
+		TempMemory iterationMemory = startTempMemory(arena);
 
 		globalToLocal(pendulum, &data);
 		validateNumbers(data.q->e, data.pieceCount * 2);
@@ -5681,10 +6884,8 @@ static void updatePendulum(MemoryArena* arena, Pendulum* pendulum, v3 dpivot, f3
 
 		localToGlobal(pendulum, &data);
 
-		ASSERT(arenaOffset == arena->offset); // just check for leaks
+		endTempMemory(&iterationMemory);
 	}
-	
-	endTempMemory(&temp);
 }
 
 static void computePiecePositions(Pendulum* pendulum, v3 pivot) //result[0] is the pivot point
@@ -5709,6 +6910,8 @@ struct Hair
 static Hair createHair(MemoryArena* arena, u32 fiberCountU, u32 fiberCountV, u32 pieceCount, 
 	f32 lCoeff, f32 l0, f32 m0, f32 headR, f32 dragCoeff, m4 hairToWorld)
 {
+	TAGGED_ARENA_BLOCK(arena);
+
 	u32 fiberCount = fiberCountU * fiberCountV;
 
 	Hair result = {};
@@ -5861,6 +7064,8 @@ static void updateSmoothCamera(SmoothCamera* cam, Input* input, f32 dt)
 	cam->view = invertOrtho3Translation(cam->model);
 }
 
+#include "benchmark.h"
+
 int CALLBACK WinMain(
 	HINSTANCE hInstance,
 	HINSTANCE hPrevInstance,
@@ -5868,15 +7073,35 @@ int CALLBACK WinMain(
 	int       nShowCmd
 )
 {
-	WorkQueue hotQueue;
-	WorkQueue coldQueue;
-	initWorkQueue(&hotQueue, 7);
-	initWorkQueue(&coldQueue, 4);
+	ASSERT(QueryPerformanceFrequency(&g_perfCounterFrequency) == TRUE);
+
+	//NOTE: -sse2 or -avx2 keeps the image kernels below what the cpu could do, to compare them
+	SIMD_LEVEL maxSimdLevel = SIMD_LEVEL_AVX512;
+	if (strstr(lpCmdLine, "-sse2"))
+	{
+		maxSimdLevel = SIMD_LEVEL_SSE2;
+	}
+	else if (strstr(lpCmdLine, "-avx2"))
+	{
+		maxSimdLevel = SIMD_LEVEL_AVX2;
+	}
+	initImageKernels(maxSimdLevel);
 
+	if (strstr(lpCmdLine, "-benchmark"))
+	{
+		runBenchmarks();
+		return 0;
+	}
 
-	ASSERT(QueryPerformanceFrequency(&g_perfCounterFrequency) == TRUE);
-	umm storageSize = 1024 * 1024 * 1024;
-	MemoryArena arena = createMemoryArena(Win32AllocateMemory(storageSize), storageSize);
+	//NOTE: one pool for everything, the main thread helps when it waits, so it doesn't get a worker
+	WorkQueue workQueue;
+	initWorkQueue(&workQueue, CLAMP(1, WORK_QUEUE_MAX_THREAD_COUNT, getLogicalProcessorCount() - 1));
+
+	//NOTE: the address range is only reserved, the memory is committed as it is used. The temp scopes on it are all in the startup,
+	// the generators' big intermediate images among them, so a rewind gives their pages back instead of keeping the peak committed
+	umm storageSize = 64ull * 1024 * 1024 * 1024;
+	MemoryArena arena = createGrowableMemoryArena(storageSize, true);
+	FrameArena frameArena = createFrameArena(1024 * 1024 * 1024);
 
 #ifdef _DEBUG
 	ID3D12Debug* debugInterface = 0;
@@ -6052,16 +7277,28 @@ int CALLBACK WinMain(
 	}
 	lightModelBuffers[3].scale = 0.5f;
 
+	//NOTE: the fractal images are walked over and over, with -largepages they sit on 2MB pages, which the TLB can cover
+	MemoryArena* fractalArena = &arena;
+	MemoryArena largePageArena = {};
+	if (strstr(lpCmdLine, "-largepages"))
+	{
+		enableLargePagePrivilege();
+		largePageArena = createLargePageMemoryArena(512 * 1024 * 1024);
+		fractalArena = &largePageArena;
+		OutputDebugStringA(largePageArena.largePages ? "Fractal images on large pages\n" : "No large pages, the fractal images are on small pages\n");
+	}
+
 	Fractal fractal;
-	createFractal(&arena, &fractal, 0.1f, 354434, 4096, 4096, 256);
+	createFractal(&workQueue, fractalArena, &fractal, 0.1f, 354434, 4096, 4096, 256);
+	addFractalTasks(fractalArena, &fractal.graph, &fractal);
 	GPUFractal gpuFractal = createGPUFractal(&resourceManager, &fractal);
 
 	ColoredFractal coloredFractal;
-	createColoredFractal(&arena, &coloredFractal, 0.5f, 121, 1024, 1024, 128);
+	createColoredFractal(&workQueue, fractalArena, &coloredFractal, 0.5f, 121, 1024, 1024, 128);
 	GPUFractal gpuColoredFractal = createGPUFractal(&resourceManager, &coloredFractal);
 
 	HeightMapFractal heightMapFractal;
-	createHeightMapFractal(&arena, &heightMapFractal, 0.1f, 6784, 4096, 4096, 512);
+	createHeightMapFractal(&workQueue, fractalArena, &heightMapFractal, 0.1f, 6784, 4096, 4096, 512);
 	GPUHeightMapFractal gpuHeightMapFractal = createGPUHeightMapFractal(&resourceManager, &heightMapFractal);
 
 	TempMemory tempMem = startTempMemory(&arena);
@@ -6090,10 +7327,21 @@ int CALLBACK WinMain(
 
 
 	tempMem = startTempMemory(&arena);
+	//NOTE: with -synthlods every lod of the height maps gets its own noise instead of being filtered from lod0,
+	// with -noisenormals the torus takes the normals of its lod0 from the noise instead of the finite differences
+	HEIGHT_MAP_LODS heightMapLods = HEIGHT_MAP_LODS_DOWNSAMPLED;
+	if (strstr(lpCmdLine, "-synthlods"))
+	{
+		heightMapLods = HEIGHT_MAP_LODS_SYNTHESIZED;
+	}
+	else if (strstr(lpCmdLine, "-noisenormals"))
+	{
+		heightMapLods = HEIGHT_MAP_LODS_DOWNSAMPLED_NOISE_NORMALS;
+	}
 	HeightMap heightMaps[2] =
 	{
-		createHeightMapForSphere(&arena, 4096, 4096, 13, 0.4f),
-		createHeightMapForTorus(&arena, 4096, 4096, 789, 0.7f),
+		createHeightMapForSphere(&workQueue, &arena, 4096, 4096, 13, 0.4f, heightMapLods),
+		createHeightMapForTorus(&workQueue, &arena, 4096, 4096, 789, 0.7f, heightMapLods),
 	};
 	GPUHeightMap gpuHeightMaps[2] =
 	{
@@ -6170,6 +7418,8 @@ int CALLBACK WinMain(
 
 	while (g_running)
 	{
+		MemoryArena* frameScratch = beginFrameArena(&frameArena);
+
 		updateInput(&input);
 		Win32ProcessPendingMessages(&input);
 		 
@@ -6196,15 +7446,15 @@ int CALLBACK WinMain(
 			rebuildGraphicsPipeline(device, &renderer.modelPipeline);
 		}
 
-		//updateFractal(&coldQueue, &fractal, dt);
-		//updateFractal(&hotQueue, &coloredFractal, dt);
-		//updateFractal(&coldQueue, &heightMapFractal, dt);
+		//updateFractal(&workQueue, &fractal, dt);
+		//updateFractal(&workQueue, &coloredFractal, dt);
+		//updateFractal(&workQueue, &heightMapFractal, dt);
 		//
 		//updateGPUFractal(&resourceManager, &renderer, &fractal, &gpuFractal);
 		//updateGPUFractal(&resourceManager, &renderer, &coloredFractal, &gpuColoredFractal);
 		//updateGPUFractal(&resourceManager, &renderer, &heightMapFractal, &gpuHeightMapFractal);
 
-		//updatePendulum(&arena, &pendulum, dpendulumPivot, dt);
+		//updatePendulum(frameScratch, &pendulum, dpendulumPivot, dt);
 		//computePiecePositions(&pendulum, pendulumPivot);
 		//{
 		//	char buffer[256];
@@ -6217,7 +7467,7 @@ int CALLBACK WinMain(
 
 		hairToWorld = cam.model;
 		hairToWorld.translation -= 5.f * hairToWorld.zAxis;
-		updateHair(&arena, &hair, hairToWorld, dt);
+		updateHair(frameScratch, &hair, hairToWorld, dt);
 		{
 			char buffer[256];
 			sprintf_s(buffer, "Hamiltonian: %f\n", computeHamiltonian(hair.fibers, {}));
@@ -6376,6 +7626,7 @@ int CALLBACK WinMain(
 		submitRender(&renderer);
 		
 		updateDebugInfo();
+		sampleWorkQueueDepth(&workQueue);
 
 		LARGE_INTEGER frameEnd = Win32GetWallClock();
 		dt = Win32GetSecondsElapsed(frameStart, frameEnd);
@@ -6390,5 +7641,18 @@ int CALLBACK WinMain(
 
 	}
 
+	//NOTE: the generations still in flight are of no use anymore, they give up early instead of running to the end
+	cancelTaskGraph(&fractal.graph);
+	cancelTaskGraph(&coloredFractal.graph);
+	cancelTaskGraph(&heightMapFractal.graph);
+	waitForTaskGraph(&fractal.graph);
+	waitForTaskGraph(&coloredFractal.graph);
+	waitForTaskGraph(&heightMapFractal.graph);
+
+	dumpWorkQueueStats(&workQueue);
+#if ARENA_PROFILER
+	dumpArenaProfile();
+#endif
+
 	return 0;
 }
\ No newline at end of file
@@ -1,28 +1,199 @@
 #include "platform.h"
 
 
+//NOTE: every push is tagged with the function it comes from, unless a tagged scope of the arena is open (TAGGED_ARENA_BLOCK or a
+// tagged temp memory), then it is counted for the innermost scope
+#define pushSize(arena, size, ...) _pushSize(__FUNCTION__, arena, size, ##__VA_ARGS__)
 #define pushStruct(arena, type) (type*)pushSize(arena, sizeof(type), alignof(type)) 
 #define pushArray(arena, count, type) (type*)pushSize(arena, sizeof(type) * (count), alignof(type)) 
 
+#define ARENA_COMMIT_SIZE (1024 * 1024) //a growable arena commits in steps of this
+
+//NOTE: off by default, every push pays for the tag lookup and a few interlocked adds. Build with -DARENA_PROFILER=1 to get the profile
+#ifndef ARENA_PROFILER
+#define ARENA_PROFILER 0
+#endif
+
+struct ArenaProfileEntry
+{
+	char* volatile tag;
+	u64 volatile pushCount;
+	u64 volatile failedPushCount;
+	u64 volatile bytes;
+	u64 volatile alignmentWaste;
+	u64 volatile peakOffset; //the highest arena offset after one of the pushes
+	u64 volatile scopeCount;
+	u64 volatile peakScopeBytes; //how far the arena went above the start of a scope
+};
+
+#define ARENA_PROFILE_ENTRY_COUNT 512
+
+global ArenaProfileEntry g_arenaProfile[ARENA_PROFILE_ENTRY_COUNT]; //NOTE: open addressing, the tags are never removed
+
+inline void atomicMax(u64 volatile* value, u64 newValue)
+{
+	u64 oldValue = *value;
+	while (newValue > oldValue)
+	{
+		u64 prevValue = (u64)_InterlockedCompareExchange64((volatile LONGLONG*)value, (LONGLONG)newValue, (LONGLONG)oldValue);
+		if (prevValue == oldValue)
+		{
+			break;
+		}
+		oldValue = prevValue;
+	}
+}
+
+static ArenaProfileEntry* getArenaProfileEntry(char* tag)
+{
+	//NOTE: the worker threads push to their scratch arenas at the same time, so the slots are claimed with a CAS.
+	// The same string at two places can have two addresses, so they are compared by content
+	u32 hash = 2166136261u;
+	for (char* at = tag; *at; ++at)
+	{
+		hash = (hash ^ (u8)*at) * 16777619u;
+	}
+
+	for (u32 probeIndex = 0; probeIndex < ARENA_PROFILE_ENTRY_COUNT; ++probeIndex)
+	{
+		ArenaProfileEntry* entry = g_arenaProfile + (hash + probeIndex) % ARENA_PROFILE_ENTRY_COUNT;
+		char* entryTag = entry->tag;
+		if (!entryTag)
+		{
+			entryTag = (char*)_InterlockedCompareExchangePointer((void* volatile*)&entry->tag, tag, 0);
+			if (!entryTag)
+			{
+				return entry;
+			}
+		}
+		if (entryTag == tag || strcmp(entryTag, tag) == 0)
+		{
+			return entry;
+		}
+	}
+	return 0; //full, the rest goes unprofiled
+}
+
+static void profileArenaPush(char* tag, umm size, umm alignmentWaste, umm offset, b32 pushed)
+{
+#if ARENA_PROFILER
+	ArenaProfileEntry* entry = getArenaProfileEntry(tag);
+	if (entry)
+	{
+		if (pushed)
+		{
+			_InterlockedIncrement64((volatile LONGLONG*)&entry->pushCount);
+			_InterlockedExchangeAdd64((volatile LONGLONG*)&entry->bytes, (LONGLONG)size);
+			_InterlockedExchangeAdd64((volatile LONGLONG*)&entry->alignmentWaste, (LONGLONG)alignmentWaste);
+			atomicMax(&entry->peakOffset, offset);
+		}
+		else
+		{
+			_InterlockedIncrement64((volatile LONGLONG*)&entry->failedPushCount);
+		}
+	}
+#endif
+}
+
 struct MemoryArena
 {
 	u8* base;
 	umm offset;
-	umm size;
+	umm size; //the reserved address range for a growable arena
 	u32 tempMemoryCount;
+
+	umm committedSize;
+	b32 growable;
+	b32 decommitOnRewind;
+	b32 largePages; //whether createLargePageMemoryArena got them
+
+	char* tag; //of the innermost tagged scope
+	umm peakOffset; //since the start of that scope
 };
 
+struct ArenaScope
+{
+	b32 tagged;
+	char* prevTag;
+	umm startOffset;
+	umm prevPeakOffset;
+};
+
+static ArenaScope beginArenaScope(MemoryArena* arena, char* tag)
+{
+	ArenaScope result = {};
+	result.prevTag = arena->tag;
+	result.startOffset = arena->offset;
+	result.prevPeakOffset = arena->peakOffset;
+	if (tag)
+	{
+		result.tagged = true;
+		arena->tag = tag;
+		arena->peakOffset = arena->offset;
+	}
+	return result;
+}
+
+static void endArenaScope(MemoryArena* arena, ArenaScope* scope)
+{
+	if (scope->tagged)
+	{
+#if ARENA_PROFILER
+		ArenaProfileEntry* entry = getArenaProfileEntry(arena->tag);
+		if (entry)
+		{
+			_InterlockedIncrement64((volatile LONGLONG*)&entry->scopeCount);
+			atomicMax(&entry->peakScopeBytes, arena->peakOffset - scope->startOffset);
+		}
+#endif
+		arena->tag = scope->prevTag;
+		arena->peakOffset = MAX(arena->peakOffset, scope->prevPeakOffset);
+	}
+}
+
+struct ArenaTagBlock
+{
+	MemoryArena* arena;
+	ArenaScope scope;
+	ArenaTagBlock(MemoryArena* arena, char* tag)
+	{
+		this->arena = arena;
+		scope = beginArenaScope(arena, tag);
+	}
+	~ArenaTagBlock()
+	{
+		endArenaScope(arena, &scope);
+	}
+};
+
+#define __TAGGED_ARENA_BLOCK(count, arena, tag) ArenaTagBlock arenaTagBlock##count (arena, tag);
+#define _TAGGED_ARENA_BLOCK(count, arena, tag) __TAGGED_ARENA_BLOCK(count, arena, tag)
+#define TAGGED_ARENA_BLOCK(arena) _TAGGED_ARENA_BLOCK(__COUNTER__, arena, __FUNCTION__)
+
+static void _shrinkArena(MemoryArena* arena)
+{
+	//NOTE: one step stays committed above the offset, so an arena going back and forth around a step boundary doesn't commit every time
+	umm keptSize = MIN(ALIGN_NUM(arena->offset, ARENA_COMMIT_SIZE) + ARENA_COMMIT_SIZE, arena->committedSize);
+	if (keptSize < arena->committedSize)
+	{
+		VirtualFree(arena->base + keptSize, arena->committedSize - keptSize, MEM_DECOMMIT);
+		arena->committedSize = keptSize;
+	}
+}
+
 struct TempMemory
 {
 	MemoryArena* arena;
 	umm offset;
+	ArenaScope scope;
 };
 
-static TempMemory startTempMemory(MemoryArena* arena)
+static TempMemory startTempMemory(MemoryArena* arena, char* tag = 0)
 {
 	TempMemory result = {};
 	result.arena = arena;
 	result.offset = arena->offset;
+	result.scope = beginArenaScope(arena, tag);
 	++arena->tempMemoryCount;
 	return result;
 }
@@ -31,9 +202,15 @@ static void endTempMemory(TempMemory* tempMemory)
 {
 	MemoryArena* arena = tempMemory->arena;
 	ASSERT(arena->offset >= tempMemory->offset);
+	endArenaScope(arena, &tempMemory->scope);
 	arena->offset = tempMemory->offset;
 	ASSERT(arena->tempMemoryCount);
 	--arena->tempMemoryCount;
+
+	if (arena->decommitOnRewind)
+	{
+		_shrinkArena(arena);
+	}
 }
 
 static MemoryArena createMemoryArena(void* base, umm size)
@@ -41,6 +218,78 @@ static MemoryArena createMemoryArena(void* base, umm size)
 	MemoryArena result = {};
 	result.base = (u8*)base;
 	result.size = size;
+	result.committedSize = size;
+	return result;
+}
+
+static MemoryArena createGrowableMemoryArena(umm reserveSize, b32 decommitOnRewind = false)
+{
+	//NOTE: only the address range is reserved, the pages are committed as the offset grows
+	MemoryArena result = {};
+	result.base = (u8*)VirtualAlloc(0, reserveSize, MEM_RESERVE, PAGE_NOACCESS);
+	ASSERT(result.base);
+	result.size = reserveSize;
+	result.growable = true;
+	result.decommitOnRewind = decommitOnRewind;
+	return result;
+}
+
+static b32 enableLargePagePrivilege()
+{
+	//NOTE: the account needs the "Lock pages in memory" right (User Rights Assignment in secpol.msc), this only switches it on for the process
+	b32 result = false;
+	HANDLE token;
+	if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+	{
+		TOKEN_PRIVILEGES privileges = {};
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		if (LookupPrivilegeValueA(0, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid))
+		{
+			//NOTE: it succeeds without the right too, only the last error tells
+			result = AdjustTokenPrivileges(token, FALSE, &privileges, 0, 0, 0) && GetLastError() == ERROR_SUCCESS;
+		}
+		CloseHandle(token);
+	}
+	return result;
+}
+
+static MemoryArena createLargePageMemoryArena(umm size)
+{
+	//NOTE: 2MB pages, so walking a big image doesn't miss the TLB on every 4KB. They can't be committed on demand,
+	// the whole size is committed up front and locked in physical memory. Without enableLargePagePrivilege or with
+	// fragmented physical memory it falls back to small pages, largePages tells which one it got
+	umm largePageSize = GetLargePageMinimum();
+	void* memory = 0;
+	if (largePageSize)
+	{
+		size = ALIGN_NUM(size, largePageSize);
+		memory = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	}
+	b32 largePages = memory != 0;
+	if (!memory)
+	{
+		memory = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	}
+	ASSERT(memory);
+
+	MemoryArena result = createMemoryArena(memory, size);
+	result.largePages = largePages;
+	return result;
+}
+
+static b32 _growArena(MemoryArena* arena, umm newOffset)
+{
+	b32 result = false;
+	if (arena->growable && newOffset <= arena->size)
+	{
+		umm newCommittedSize = MIN(ALIGN_NUM(newOffset, ARENA_COMMIT_SIZE), arena->size);
+		if (VirtualAlloc(arena->base + arena->committedSize, newCommittedSize - arena->committedSize, MEM_COMMIT, PAGE_READWRITE))
+		{
+			arena->committedSize = newCommittedSize;
+			result = true;
+		}
+	}
 	return result;
 }
 
@@ -49,7 +298,7 @@ static void validateArena(MemoryArena* arena)
 	ASSERT(arena->tempMemoryCount == 0);
 }
 
-static void* pushSize(MemoryArena* arena, umm size, umm alignment = 4)
+static void* _pushSize(char* tag, MemoryArena* arena, umm size, umm alignment = 4)
 {
 	u8* result = 0;
 
@@ -57,12 +306,14 @@ static void* pushSize(MemoryArena* arena, umm size, umm alignment = 4)
 	ASSERT(IS_POW2(alignment));
 	u8* aligned = ALIGN_PTR(at, alignment);
 	umm alignedSize = (aligned - at) + size;
-	if (arena->offset + alignedSize <= arena->size)
+	if (arena->offset + alignedSize <= arena->committedSize || _growArena(arena, arena->offset + alignedSize))
 	{
 		arena->offset += alignedSize;
+		arena->peakOffset = MAX(arena->peakOffset, arena->offset);
 		result = aligned;
 	}
 
+	profileArenaPush(arena->tag ? arena->tag : tag, size, aligned - at, arena->offset, result != 0);
 	return result;
 }
 
@@ -77,3 +328,432 @@ static void* pushAlignment(MemoryArena* arena, umm alignment)
 {
 	return pushSize(arena, 0, alignment);
 }
+
+#define FRAME_ARENA_BUFFER_COUNT 2
+
+//NOTE: scratch that lives for a frame, nothing is popped, the whole buffer is reset when its turn comes again
+struct FrameArena
+{
+	MemoryArena buffers[FRAME_ARENA_BUFFER_COUNT];
+	u32 frameIndex;
+};
+
+static FrameArena createFrameArena(umm reserveSize)
+{
+	//NOTE: the buffers stay committed up to the biggest frame so far
+	FrameArena result = {};
+	for (u32 i = 0; i < FRAME_ARENA_BUFFER_COUNT; ++i)
+	{
+		result.buffers[i] = createGrowableMemoryArena(reserveSize);
+		result.buffers[i].tag = "FrameArena";
+	}
+	return result;
+}
+
+static MemoryArena* beginFrameArena(FrameArena* frameArena)
+{
+	//NOTE: the buffer of the frame before is left alone, what was pushed there stays valid while this frame is built
+	++frameArena->frameIndex;
+	MemoryArena* result = frameArena->buffers + frameArena->frameIndex % FRAME_ARENA_BUFFER_COUNT;
+	validateArena(result);
+	result->offset = 0;
+	result->peakOffset = 0;
+	return result;
+}
+
+static MemoryArena* getPrevFrameArena(FrameArena* frameArena)
+{
+	return frameArena->buffers + (frameArena->frameIndex + FRAME_ARENA_BUFFER_COUNT - 1) % FRAME_ARENA_BUFFER_COUNT;
+}
+
+#define CONCURRENT_ARENA_CHUNK_SIZE (64 * 1024)
+#define CONCURRENT_ARENA_CACHED_CHUNK_COUNT 4
+
+//NOTE: any thread can push, every thread bumps in its own chunk and only taking a new chunk touches the shared offset.
+// There is no temp memory, the arena is reset as a whole once nobody pushes anymore
+struct ConcurrentMemoryArena
+{
+	u8* base;
+	umm volatile offset;
+	umm size;
+	umm volatile committedSize; //everything below is committed
+	b32 growable;
+	u32 volatile generation; //new for every reset, the threads drop their chunks then
+};
+
+struct ConcurrentArenaChunk
+{
+	ConcurrentMemoryArena* arena;
+	u32 generation;
+	u8* at;
+	u8* end;
+};
+
+global u32 volatile g_nextConcurrentArenaGeneration; //unique over all arenas, a new arena at the address of a released one can't match old chunks
+global thread_local ConcurrentArenaChunk t_concurrentArenaChunks[CONCURRENT_ARENA_CACHED_CHUNK_COUNT];
+global thread_local u32 t_nextConcurrentArenaChunk;
+
+static ConcurrentMemoryArena createConcurrentMemoryArena(void* base, umm size)
+{
+	ConcurrentMemoryArena result = {};
+	result.base = (u8*)base;
+	result.size = size;
+	result.committedSize = size;
+	result.generation = _InterlockedIncrement((volatile LONG*)&g_nextConcurrentArenaGeneration);
+	return result;
+}
+
+static ConcurrentMemoryArena createGrowableConcurrentMemoryArena(umm reserveSize)
+{
+	ConcurrentMemoryArena result = {};
+	result.base = (u8*)VirtualAlloc(0, reserveSize, MEM_RESERVE, PAGE_NOACCESS);
+	ASSERT(result.base);
+	result.size = reserveSize;
+	result.growable = true;
+	result.generation = _InterlockedIncrement((volatile LONG*)&g_nextConcurrentArenaGeneration);
+	return result;
+}
+
+static void resetConcurrentMemoryArena(ConcurrentMemoryArena* arena)
+{
+	arena->offset = 0;
+	arena->generation = _InterlockedIncrement((volatile LONG*)&g_nextConcurrentArenaGeneration);
+}
+
+static u8* _takeConcurrentArenaRange(ConcurrentMemoryArena* arena, umm size)
+{
+	//NOTE: a compare exchange and not an add, a take which doesn't fit leaves the offset alone, so a smaller one can still fit after it
+	umm start = arena->offset;
+	umm end;
+	for (;;)
+	{
+		end = start + size;
+		if (end > arena->size)
+		{
+			return 0;
+		}
+		umm prevStart = (umm)_InterlockedCompareExchange64((volatile LONGLONG*)&arena->offset, (LONGLONG)end, (LONGLONG)start);
+		if (prevStart == start)
+		{
+			break;
+		}
+		start = prevStart;
+	}
+
+	//NOTE: whoever raises the committed size commits from the old one, so a range below it is always committed,
+	// even when its owner is still behind. Committing a page twice does no harm
+	umm committedSize = arena->committedSize;
+	while (end > committedSize)
+	{
+		ASSERT(arena->growable);
+		umm newCommittedSize = MIN(ALIGN_NUM(end, ARENA_COMMIT_SIZE), arena->size);
+		if (!VirtualAlloc(arena->base + committedSize, newCommittedSize - committedSize, MEM_COMMIT, PAGE_READWRITE))
+		{
+			return 0;
+		}
+		umm prevCommittedSize = (umm)_InterlockedCompareExchange64((volatile LONGLONG*)&arena->committedSize, (LONGLONG)newCommittedSize, (LONGLONG)committedSize);
+		committedSize = prevCommittedSize == committedSize ? newCommittedSize : prevCommittedSize;
+	}
+
+	return arena->base + start;
+}
+
+static void* _pushSize(char* tag, ConcurrentMemoryArena* arena, umm size, umm alignment = 4)
+{
+	ASSERT(IS_POW2(alignment) && alignment <= CONCURRENT_ARENA_CHUNK_SIZE);
+
+	//NOTE: the big ones go straight to the arena, so they don't waste most of a chunk
+	if (size > CONCURRENT_ARENA_CHUNK_SIZE / 4)
+	{
+		u8* range = _takeConcurrentArenaRange(arena, size + alignment - 1);
+		u8* aligned = range ? ALIGN_PTR(range, alignment) : 0;
+		profileArenaPush(tag, size, aligned - range, arena->offset, range != 0);
+		return aligned;
+	}
+
+	ConcurrentArenaChunk* chunk = 0;
+	for (u32 chunkIndex = 0; chunkIndex < CONCURRENT_ARENA_CACHED_CHUNK_COUNT; ++chunkIndex)
+	{
+		ConcurrentArenaChunk* cachedChunk = t_concurrentArenaChunks + chunkIndex;
+		if (cachedChunk->arena == arena && cachedChunk->generation == arena->generation)
+		{
+			chunk = cachedChunk;
+			break;
+		}
+	}
+
+	u8* aligned = chunk ? ALIGN_PTR(chunk->at, alignment) : 0;
+	if (!chunk || aligned + size > chunk->end)
+	{
+		if (!chunk)
+		{
+			chunk = t_concurrentArenaChunks + t_nextConcurrentArenaChunk++ % CONCURRENT_ARENA_CACHED_CHUNK_COUNT;
+		}
+		u8* range = _takeConcurrentArenaRange(arena, CONCURRENT_ARENA_CHUNK_SIZE);
+		if (!range)
+		{
+			*chunk = {};
+			profileArenaPush(tag, size, 0, arena->offset, false);
+			return 0;
+		}
+		chunk->arena = arena;
+		chunk->generation = arena->generation;
+		chunk->at = range;
+		chunk->end = range + CONCURRENT_ARENA_CHUNK_SIZE;
+		aligned = ALIGN_PTR(chunk->at, alignment);
+	}
+
+	profileArenaPush(tag, size, aligned - chunk->at, arena->offset, true);
+	chunk->at = aligned + size;
+	return aligned;
+}
+
+#define MEMORY_POOL_BLOCK_ELEMENT_COUNT 256
+#define MEMORY_POOL_CACHE_BATCH_COUNT 32
+#define MEMORY_POOL_CACHED_POOL_COUNT 4
+
+struct MemoryPoolNode
+{
+	MemoryPoolNode* next;
+};
+
+//NOTE: fixed size elements with O(1) allocate and free, for things which die in any order. The free elements are linked through
+// their own memory, new ones are pushed from the arena a block at a time and never go back to it.
+// A pool on a MemoryArena is as single threaded as its arena, only the thread which created it may use it.
+// A pool on a ConcurrentMemoryArena has thread caches, every thread keeps a few free elements for itself and only moves a batch
+// from or to the shared list under the lock, then the pool has to outlive the threads which used it
+struct MemoryPool
+{
+	MemoryArena* arena;
+	ConcurrentMemoryArena* concurrentArena; //instead of the arena for the thread caches, others can push to it while we grow
+	char* tag; //for the arena profile
+	umm elementSize;
+	umm alignment;
+	u32 blockElementCount;
+	b32 threadCaches;
+	DWORD ownerThreadId; //without thread caches
+
+	u32 volatile lock;
+	MemoryPoolNode* firstFree;
+	u64 elementCount; //taken from the arena so far
+};
+
+struct MemoryPoolCache
+{
+	MemoryPool* pool;
+	MemoryPoolNode* firstFree;
+	u32 count;
+};
+
+global thread_local MemoryPoolCache t_memoryPoolCaches[MEMORY_POOL_CACHED_POOL_COUNT];
+global thread_local u32 t_nextMemoryPoolCache;
+
+static MemoryPool _initMemoryPool(char* tag, umm elementSize, umm alignment, u32 blockElementCount)
+{
+	MemoryPool result = {};
+	result.tag = tag;
+	result.alignment = MAX(alignment, alignof(MemoryPoolNode));
+	result.elementSize = ALIGN_NUM(MAX(elementSize, sizeof(MemoryPoolNode)), result.alignment);
+	result.blockElementCount = blockElementCount;
+	return result;
+}
+
+static MemoryPool _createMemoryPool(char* tag, MemoryArena* arena, umm elementSize, umm alignment, u32 blockElementCount = MEMORY_POOL_BLOCK_ELEMENT_COUNT)
+{
+	MemoryPool result = _initMemoryPool(tag, elementSize, alignment, blockElementCount);
+	result.arena = arena;
+	result.ownerThreadId = GetCurrentThreadId();
+	return result;
+}
+
+static MemoryPool _createMemoryPool(char* tag, ConcurrentMemoryArena* arena, umm elementSize, umm alignment, u32 blockElementCount = MEMORY_POOL_BLOCK_ELEMENT_COUNT)
+{
+	MemoryPool result = _initMemoryPool(tag, elementSize, alignment, blockElementCount);
+	result.concurrentArena = arena;
+	result.threadCaches = true;
+	return result;
+}
+
+#define createMemoryPool(arena, type, ...) _createMemoryPool(#type, arena, sizeof(type), alignof(type), ##__VA_ARGS__)
+
+inline void _lockMemoryPool(MemoryPool* pool)
+{
+	if (pool->threadCaches)
+	{
+		while (_InterlockedExchange((volatile LONG*)&pool->lock, 1))
+		{
+			_mm_pause();
+		}
+	}
+}
+
+inline void _unlockMemoryPool(MemoryPool* pool)
+{
+	if (pool->threadCaches)
+	{
+		_InterlockedExchange((volatile LONG*)&pool->lock, 0);
+	}
+}
+
+static b32 _growMemoryPool(MemoryPool* pool)
+{
+	//NOTE: called with the lock held, the lock only keeps out the other users of the pool, not the ones of its arena
+	umm blockSize = pool->elementSize * pool->blockElementCount;
+	u8* block = pool->threadCaches ? (u8*)_pushSize(pool->tag, pool->concurrentArena, blockSize, pool->alignment) :
+		(u8*)_pushSize(pool->tag, pool->arena, blockSize, pool->alignment);
+	if (block)
+	{
+		for (u32 elementIndex = pool->blockElementCount; elementIndex > 0; --elementIndex)
+		{
+			MemoryPoolNode* node = (MemoryPoolNode*)(block + (elementIndex - 1) * pool->elementSize);
+			node->next = pool->firstFree;
+			pool->firstFree = node;
+		}
+		pool->elementCount += pool->blockElementCount;
+	}
+	return block != 0;
+}
+
+static MemoryPoolCache* _getMemoryPoolCache(MemoryPool* pool)
+{
+	for (u32 cacheIndex = 0; cacheIndex < MEMORY_POOL_CACHED_POOL_COUNT; ++cacheIndex)
+	{
+		if (t_memoryPoolCaches[cacheIndex].pool == pool)
+		{
+			return t_memoryPoolCaches + cacheIndex;
+		}
+	}
+
+	//NOTE: the evicted pool gets its elements back
+	MemoryPoolCache* result = t_memoryPoolCaches + t_nextMemoryPoolCache++ % MEMORY_POOL_CACHED_POOL_COUNT;
+	if (result->pool && result->firstFree)
+	{
+		MemoryPoolNode* last = result->firstFree;
+		while (last->next)
+		{
+			last = last->next;
+		}
+		_lockMemoryPool(result->pool);
+		last->next = result->pool->firstFree;
+		result->pool->firstFree = result->firstFree;
+		_unlockMemoryPool(result->pool);
+	}
+	*result = {};
+	result->pool = pool;
+	return result;
+}
+
+static void* _allocateFromPool(MemoryPool* pool, umm size)
+{
+	ASSERT(size <= pool->elementSize);
+	MemoryPoolNode* result = 0;
+	if (pool->threadCaches)
+	{
+		MemoryPoolCache* cache = _getMemoryPoolCache(pool);
+		if (!cache->firstFree)
+		{
+			_lockMemoryPool(pool);
+			if (pool->firstFree || _growMemoryPool(pool))
+			{
+				MemoryPoolNode* last = pool->firstFree;
+				cache->count = 1;
+				while (last->next && cache->count < MEMORY_POOL_CACHE_BATCH_COUNT)
+				{
+					last = last->next;
+					++cache->count;
+				}
+				cache->firstFree = pool->firstFree;
+				pool->firstFree = last->next;
+				last->next = 0;
+			}
+			_unlockMemoryPool(pool);
+		}
+
+		result = cache->firstFree;
+		if (result)
+		{
+			cache->firstFree = result->next;
+			--cache->count;
+		}
+	}
+	else
+	{
+		ASSERT(GetCurrentThreadId() == pool->ownerThreadId);
+		if (pool->firstFree || _growMemoryPool(pool))
+		{
+			result = pool->firstFree;
+			pool->firstFree = result->next;
+		}
+	}
+	return result;
+}
+
+#define allocateFromPool(pool, type) (type*)_allocateFromPool(pool, sizeof(type))
+
+static void freeToPool(MemoryPool* pool, void* element)
+{
+	MemoryPoolNode* node = (MemoryPoolNode*)element;
+	if (pool->threadCaches)
+	{
+		MemoryPoolCache* cache = _getMemoryPoolCache(pool);
+		node->next = cache->firstFree;
+		cache->firstFree = node;
+		++cache->count;
+
+		//NOTE: a thread which only frees gives the surplus back, so the elements don't pile up where nobody allocates
+		if (cache->count >= 2 * MEMORY_POOL_CACHE_BATCH_COUNT)
+		{
+			MemoryPoolNode* first = cache->firstFree;
+			MemoryPoolNode* last = first;
+			for (u32 nodeIndex = 1; nodeIndex < MEMORY_POOL_CACHE_BATCH_COUNT; ++nodeIndex)
+			{
+				last = last->next;
+			}
+			cache->firstFree = last->next;
+			cache->count -= MEMORY_POOL_CACHE_BATCH_COUNT;
+
+			_lockMemoryPool(pool);
+			last->next = pool->firstFree;
+			pool->firstFree = first;
+			_unlockMemoryPool(pool);
+		}
+	}
+	else
+	{
+		ASSERT(GetCurrentThreadId() == pool->ownerThreadId);
+		node->next = pool->firstFree;
+		pool->firstFree = node;
+	}
+}
+
+static void dumpArenaProfile()
+{
+	//NOTE: the biggest first
+	char buff[512];
+	OutputDebugStringA("Arena profile\n  tag                                   pushes        bytes   alignment waste  peak offset  scopes  peak in scope  failed\n");
+
+	b32 printed[ARENA_PROFILE_ENTRY_COUNT] = {};
+	while (true)
+	{
+		ArenaProfileEntry* biggest = 0;
+		u32 biggestIndex = 0;
+		for (u32 entryIndex = 0; entryIndex < ARENA_PROFILE_ENTRY_COUNT; ++entryIndex)
+		{
+			ArenaProfileEntry* entry = g_arenaProfile + entryIndex;
+			if (entry->tag && !printed[entryIndex] && (!biggest || MAX(entry->bytes, entry->peakScopeBytes) > MAX(biggest->bytes, biggest->peakScopeBytes)))
+			{
+				biggest = entry;
+				biggestIndex = entryIndex;
+			}
+		}
+		if (!biggest)
+		{
+			break;
+		}
+		printed[biggestIndex] = true;
+
+		sprintf_s(buff, "  %-32s %11llu %12llu %17llu %12llu %7llu %14llu %7llu\n", biggest->tag, biggest->pushCount, biggest->bytes,
+			biggest->alignmentWaste, biggest->peakOffset, biggest->scopeCount, biggest->peakScopeBytes, biggest->failedPushCount);
+		OutputDebugStringA(buff);
+	}
+}